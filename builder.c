@@ -0,0 +1,216 @@
+
+#include "common.h"
+#include "builder.h"
+
+/*
+ * Values that are made in code are collected here and then loaded into the
+ * config store all at once. The entries are sorted by name, and a name that
+ * is given more than once is merged according to the policy, in the order
+ * the entries were added, instead of being an error.
+ */
+typedef struct {
+    const char* name;   // the same as val->name, but sorting is faster
+    Value* val;
+    int seq;    // keeps the sort stable for duplicate names
+} BuildEntry;
+
+struct _cfg_builder {
+    int policy;
+    BuildEntry* list;
+    int cap;
+    int len;
+};
+
+static int comp_seq(const void* left, const void* right)
+{
+    const BuildEntry* l = left;
+    const BuildEntry* r = right;
+
+    return (l->seq > r->seq) - (l->seq < r->seq);
+}
+
+static int comp_entries(const BuildEntry* l, const BuildEntry* r)
+{
+    int x = strcmp(l->name, r->name);
+    if(x != 0)
+        return x;
+
+    return comp_seq(l, r);
+}
+
+static void swap_entries(BuildEntry* list, int a, int b)
+{
+    BuildEntry tmp = list[a];
+    list[a] = list[b];
+    list[b] = tmp;
+}
+
+#define CHAR_AT(e, d) ((unsigned char)(e).name[d])
+
+/*
+ * Multikey quicksort. Names in a config have long common prefixes, such as
+ * the section names, and this only looks at each character once for each
+ * partition instead of comparing the whole prefix again every time. The
+ * characters before depth are known to be the same for the whole range.
+ */
+static void sort_entries(BuildEntry* list, int count, int depth)
+{
+    while(count > 1) {
+        if(count < 16) {
+            for(int i = 1; i < count; i++)
+                for(int j = i; j > 0 && comp_entries(&list[j-1], &list[j]) > 0; j--)
+                    swap_entries(list, j-1, j);
+            return;
+        }
+
+        swap_entries(list, 0, count/2);
+        int pivot = CHAR_AT(list[0], depth);
+
+        // lt..gt-1 are equal to the pivot when this is done
+        int lt = 0, i = 1, gt = count;
+        while(i < gt) {
+            int ch = CHAR_AT(list[i], depth);
+            if(ch < pivot)
+                swap_entries(list, lt++, i++);
+            else if(ch > pivot)
+                swap_entries(list, i, --gt);
+            else
+                i++;
+        }
+
+        sort_entries(list, lt, depth);
+        sort_entries(&list[gt], count-gt, depth);
+
+        // the names in the middle are the same to the end, so order them by seq
+        if(pivot == 0) {
+            qsort(&list[lt], gt-lt, sizeof(BuildEntry), comp_seq);
+            return;
+        }
+
+        list = &list[lt];
+        count = gt-lt;
+        depth++;
+    }
+}
+
+static Value* add_entry(CfgBuilder* builder, const char* name)
+{
+    if(builder->len+1 > builder->cap) {
+        builder->cap <<= 1;
+        builder->list = _realloc_ds_array(builder->list, BuildEntry, builder->cap);
+    }
+
+    BuildEntry* entry = &builder->list[builder->len];
+    entry->val = create_detached_val(name);
+    entry->name = entry->val->name;
+    entry->seq = builder->len++;
+
+    return entry->val;
+}
+
+/*
+ * The policy is one of CFG_REPLACE, CFG_APPEND, or CFG_PREPEND. It says what
+ * happens when a name is given more than once, or when it is already in the
+ * config store.
+ */
+CfgBuilder* createBuilder(int policy)
+{
+    if(policy != CFG_REPLACE && policy != CFG_APPEND && policy != CFG_PREPEND)
+        cfgFatalError("unknown duplicate policy: %d", policy);
+
+    CfgBuilder* builder = _alloc_ds(CfgBuilder);
+    builder->policy = policy;
+    builder->cap = 1 << 6;
+    builder->len = 0;
+    builder->list = _alloc_ds_array(BuildEntry, builder->cap);
+
+    return builder;
+}
+
+/*
+ * A string from createLiteral() still points at the one the caller gave it,
+ * but the store frees the strings in its values, so use the copy that
+ * belongs to the literal.
+ */
+static void take_literal(Value* val, Literal* lit)
+{
+    if(lit->type == VAL_STR || lit->type == VAL_NAME)
+        lit->data.str = lit->str;
+
+    lit->prev = lit->next = NULL;
+    appendLiteral(val, lit);
+}
+
+/*
+ * Add a literal to a value. A name that is given again is merged with the
+ * earlier ones according to the policy, so builderAddList() is used to
+ * build a list. The literal belongs to the builder after this.
+ */
+void builderAdd(CfgBuilder* builder, const char* name, Literal* lit)
+{
+    assert(builder != NULL);
+    assert(name != NULL);
+    assert(lit != NULL);
+
+    take_literal(add_entry(builder, name), lit);
+}
+
+void builderAddList(CfgBuilder* builder, const char* name, Literal** lits, int count)
+{
+    assert(builder != NULL);
+    assert(name != NULL);
+    assert(lits != NULL);
+
+    Value* val = add_entry(builder, name);
+    for(int i = 0; i < count; i++)
+        take_literal(val, lits[i]);
+}
+
+/*
+ * Load everything into the config store and release the builder. Returns
+ * the number of names that were merged with another one.
+ */
+int commitBuilder(CfgBuilder* builder)
+{
+    assert(builder != NULL);
+
+    // generated names are very often in order already
+    int sorted = 1;
+    for(int i = 1; i < builder->len && sorted; i++)
+        if(comp_entries(&builder->list[i-1], &builder->list[i]) > 0)
+            sorted = 0;
+
+    if(!sorted)
+        sort_entries(builder->list, builder->len, 0);
+
+    Value** vals = _alloc_ds_array(Value*, builder->len+1);
+    for(int i = 0; i < builder->len; i++)
+        vals[i] = builder->list[i].val;
+
+    int dups = load_store_vals(vals, builder->len, builder->policy);
+
+    _free(vals);
+    builder->len = 0;
+    freeBuilder(builder);
+
+    return dups;
+}
+
+/*
+ * Release a builder without loading it.
+ */
+void freeBuilder(CfgBuilder* builder)
+{
+    assert(builder != NULL);
+
+    for(int i = 0; i < builder->len; i++) {
+        Value* val = builder->list[i].val;
+        clearValList(val);
+        _free(val->list);
+        _free(val->name);
+        _free(val);
+    }
+
+    _free(builder->list);
+    _free(builder);
+}
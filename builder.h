@@ -0,0 +1,14 @@
+#ifndef BUILDER_H
+#define BUILDER_H
+
+#include "values.h"
+
+typedef struct _cfg_builder CfgBuilder;
+
+CfgBuilder* createBuilder(int policy);
+void builderAdd(CfgBuilder* builder, const char* name, Literal* lit);
+void builderAddList(CfgBuilder* builder, const char* name, Literal** lits, int count);
+int commitBuilder(CfgBuilder* builder);
+void freeBuilder(CfgBuilder* builder);
+
+#endif
@@ -11,14 +11,35 @@
 
 #include "memory.h"
 #include "values.h"
+#include "cond.h"
 #include "parser.h"
 #include "scanner.h"
 #include "errors.h"
 
+typedef struct {
+    Value** list;
+    int cap;
+    int len;
+} ValArray;
+
+void init_val_array(ValArray* arr);
+Value* create_store_val(Value** store, const char* name);
+void take_store_vals(ValArray* arr, Value** store);
+void sort_val_array(ValArray* arr);
+void merge_store_vals(ValArray* arrs, int count);
+void publish_store_vals(Value* frag, Value** retired);
+void free_retired_vals(Value* retired);
+Value* create_detached_val(const char* name);
+int load_store_vals(Value** vals, int count, int policy);
+Value* find_store_val(Value* store, const char* name);
+Value* get_cfg_store();
+unsigned long get_store_gen();
+Value* find_image_val(const char* name);
+
 void cfgFatalError(const char* fmt, ...);
 void cfgWarning(const char* fmt, ...);
 #define cfg_syntax cfg_error
-void cfg_error(const char *s);
+void cfg_error(void* loc, void* scanner, const char *s);
 int getCfgErrors();
 int getCfgWarnings();
 
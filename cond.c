@@ -0,0 +1,610 @@
+
+#include "common.h"
+#include "config.h"
+
+/*
+ * The conditional tree that the parser builds. When a config is read
+ * normally, every top level item is turned into values as soon as it has
+ * been parsed. When it is compiled, the tree is kept so that it can be
+ * instantiated for different sets of defines. Only the branches that are
+ * taken are visited. The references in strings are found when the tree is
+ * built, and they are substituted into buffers that are kept for the item.
+ */
+typedef struct {
+    char* buf;
+    int cap;
+    int len;
+} FmtBuf;
+
+typedef struct {
+    Value** store;
+    char* buf;
+    int cap;
+    int len;
+    FmtBuf fmt[2];  // for the two sides of a comparison
+} InstCtx;
+
+// how deep the references in the values of references are followed
+#define MAX_REF_DEPTH 16
+
+typedef struct {
+    const char* start;
+    const char* end;
+    const char* name;
+    int len;
+    int index;
+} RefPos;
+
+CfgNode* create_node(int type, const char* name)
+{
+    CfgNode* node = _alloc_ds(CfgNode);
+    node->type = type;
+    node->kind = 0;
+    node->line_no = get_line_no();
+    node->name = (name != NULL)? _copy_str(name): NULL;
+    node->expr = NULL;
+    node->first = NULL;
+    node->last = NULL;
+    node->body = NULL;
+    node->next = NULL;
+    node->tail = node;
+
+    return node;
+}
+
+CfgNode* append_node(CfgNode* list, CfgNode* node)
+{
+    if(list == NULL)
+        return node;
+
+    list->tail->next = node;
+    list->tail = node->tail;
+
+    return list;
+}
+
+void add_node_literal(CfgNode* node, Literal* lit)
+{
+    lit->prev = node->last;
+    lit->next = NULL;
+    if(node->last != NULL)
+        node->last->next = lit;
+    else
+        node->first = lit;
+    node->last = lit;
+}
+
+/*
+ * Find the next "$(name)" or "$(name,index)" in the string, the same way that
+ * formatStrLiteral() does. Returns 1 if one was found, 0 if there are no more,
+ * and -1 if the index is not valid.
+ */
+static int find_ref(const char* str, RefPos* ref)
+{
+    const char* start = strstr(str, "$(");
+    if(start == NULL)
+        return 0;
+
+    const char* ptr = &start[2];
+    while(*ptr != '\0' && *ptr != ')' && *ptr != ',')
+        ptr++;
+
+    // not closed, so it is only text
+    if(*ptr == '\0')
+        return 0;
+
+    ref->start = start;
+    ref->name = &start[2];
+    ref->len = ptr - ref->name;
+    ref->index = 0;
+    if(*ptr == ',') {
+        for(ptr++; isdigit(*ptr); ptr++)
+            ref->index = ref->index * 10 + (*ptr - '0');
+        if(*ptr != ')')
+            return -1;
+    }
+    ref->end = ptr+1;
+
+    return 1;
+}
+
+static void add_ref(CfgExpr* expr, const char* text, int len, const char* name, int index)
+{
+    expr->refs = _realloc_ds_array(expr->refs, CfgRef, expr->count+1);
+    CfgRef* ref = &expr->refs[expr->count++];
+    ref->text = text;
+    ref->len = len;
+    ref->name = name;
+    ref->index = index;
+}
+
+/*
+ * Split a string literal into its references, so that they do not have to be
+ * found again every time the expression is evaluated.
+ */
+static void compile_refs(CfgExpr* expr)
+{
+    const char* str = expr->lit->data.str;
+    RefPos ref;
+    int found;
+
+    while((found = find_ref(str, &ref)) > 0) {
+        char* name = _alloc(ref.len+1);
+        memcpy(name, ref.name, ref.len);
+        name[ref.len] = '\0';
+        add_ref(expr, str, ref.start - str, name, ref.index);
+        str = ref.end;
+    }
+
+    if(found < 0) {
+        fprintf(stderr, "cfg syntax error: %d: invalid index near '%s'\n", get_line_no(), expr->lit->data.str);
+        exit(1);
+    }
+
+    add_ref(expr, str, strlen(str), NULL, 0);
+}
+
+CfgExpr* create_expr(int op, CfgExpr* left, CfgExpr* right, Literal* lit)
+{
+    CfgExpr* expr = _alloc_ds(CfgExpr);
+    expr->op = op;
+    expr->lit = lit;
+    expr->refs = NULL;
+    expr->count = 0;
+    expr->left = left;
+    expr->right = right;
+
+    if(op == EXPR_LIT && lit->type == VAL_STR && strstr(lit->data.str, "$(") != NULL) {
+        expr->op = EXPR_FMT;
+        compile_refs(expr);
+    }
+
+    return expr;
+}
+
+/*
+ * The scanner makes a separate copy of the string for a NAME, and uses the
+ * same one for a STR.
+ */
+void free_literal(Literal* lit)
+{
+    if(lit == NULL)
+        return;
+
+    if((lit->type == VAL_STR || lit->type == VAL_NAME) && lit->data.str != lit->str)
+        _free(lit->data.str);
+    _free(lit->str);
+    _free(lit);
+}
+
+void free_expr(CfgExpr* expr)
+{
+    if(expr == NULL)
+        return;
+
+    free_expr(expr->left);
+    free_expr(expr->right);
+    free_literal(expr->lit);
+    for(int i = 0; i < expr->count; i++)
+        _free(expr->refs[i].name);
+    _free(expr->refs);
+    _free(expr);
+}
+
+void free_node(CfgNode* node)
+{
+    CfgNode* next;
+
+    for(; node != NULL; node = next) {
+        next = node->next;
+
+        Literal* lit = node->first;
+        while(lit != NULL) {
+            Literal* tmp = lit->next;
+            free_literal(lit);
+            lit = tmp;
+        }
+
+        free_node(node->body);
+        free_expr(node->expr);
+        _free(node->name);
+        _free(node);
+    }
+}
+
+/*
+ * Values that have not been merged into the global store yet are looked at
+ * first.
+ */
+static Value* find_inst_val(InstCtx* ctx, const char* name)
+{
+    Value* val = NULL;
+
+    if(ctx->store != NULL)
+        val = find_store_val(*ctx->store, name);
+
+    return (val != NULL)? val: findValue(name);
+}
+
+static void add_fmt(FmtBuf* buf, const char* str, int len)
+{
+    if(buf->len+len+1 > buf->cap) {
+        if(buf->cap == 0)
+            buf->cap = 1 << 6;
+        while(buf->len+len+1 > buf->cap)
+            buf->cap <<= 1;
+        buf->buf = _realloc_ds_array(buf->buf, char, buf->cap);
+    }
+
+    memcpy(&buf->buf[buf->len], str, len);
+    buf->len += len;
+    buf->buf[buf->len] = '\0';
+}
+
+static void add_text(InstCtx* ctx, FmtBuf* buf, const char* str, int depth);
+
+/*
+ * A reference that is not found is left in the string.
+ */
+static void add_ref_val(InstCtx* ctx, FmtBuf* buf, const char* name, int index, int depth)
+{
+    Value* val = find_inst_val(ctx, name);
+    Literal* lit = (val != NULL)? getLiteral(val, index): NULL;
+    char tmp[64];
+
+    if(lit == NULL) {
+        add_fmt(buf, "$(", 2);
+        add_fmt(buf, name, strlen(name));
+        snprintf(tmp, sizeof(tmp), ",%d)", index);
+        add_fmt(buf, tmp, strlen(tmp));
+        return;
+    }
+
+    switch(lit->type) {
+        case VAL_STR:
+        case VAL_NAME:
+            add_text(ctx, buf, lit->data.str, depth+1);
+            return;
+        case VAL_NUM:   snprintf(tmp, sizeof(tmp), "%ld", lit->data.num); break;
+        case VAL_FNUM:  snprintf(tmp, sizeof(tmp), "%f", lit->data.fnum); break;
+        case VAL_BOOL:  strcpy(tmp, lit->data.bval? "TRUE": "FALSE"); break;
+        default: cfgFatalError("unknown value type: %d", lit->type);
+    }
+    add_fmt(buf, tmp, strlen(tmp));
+}
+
+/*
+ * The value of a reference can have references in it too. They are only
+ * found here, since they are not known when the tree is built.
+ */
+static void add_text(InstCtx* ctx, FmtBuf* buf, const char* str, int depth)
+{
+    RefPos ref;
+
+    while(depth < MAX_REF_DEPTH && find_ref(str, &ref) > 0) {
+        add_fmt(buf, str, ref.start - str);
+        char* name = _alloc(ref.len+1);
+        memcpy(name, ref.name, ref.len);
+        name[ref.len] = '\0';
+        add_ref_val(ctx, buf, name, ref.index, depth);
+        _free(name);
+        str = ref.end;
+    }
+
+    add_fmt(buf, str, strlen(str));
+}
+
+/*
+ * Substitute the references in a string into one of the buffers in the
+ * context, using the parts that were split out when the tree was built.
+ */
+static const char* format_expr(InstCtx* ctx, CfgExpr* expr, FmtBuf* buf)
+{
+    buf->len = 0;
+    add_fmt(buf, "", 0);
+
+    for(int i = 0; i < expr->count; i++) {
+        CfgRef* ref = &expr->refs[i];
+        add_fmt(buf, ref->text, ref->len);
+        if(ref->name != NULL)
+            add_ref_val(ctx, buf, ref->name, ref->index, 0);
+    }
+
+    return buf->buf;
+}
+
+static unsigned char comp_vals(Literal* left, Literal* right)
+{
+    switch(left->type) {
+        case VAL_ERROR:
+            return (right->type == VAL_ERROR);
+        case VAL_NAME:
+            switch(right->type) {
+                case VAL_NAME:  return (strcmp(left->str, right->str) == 0);
+                case VAL_STR:   return (strcmp(left->data.str, right->data.str) == 0);
+                default:        return 0;
+            }
+        case VAL_STR:
+            switch(right->type) {
+                case VAL_NAME:
+                case VAL_STR:   return (strcmp(left->data.str, right->data.str) == 0);
+                default:        return 0;
+            }
+        case VAL_NUM:
+            switch(right->type) {
+                case VAL_NUM:   return (left->data.num == right->data.num);
+                case VAL_FNUM:  return (left->data.num == right->data.fnum);
+                case VAL_BOOL:  return (left->data.num == right->data.bval);
+                default:        return 0;
+            }
+        case VAL_FNUM:
+            switch(right->type) {
+                case VAL_NUM:   return (left->data.fnum == right->data.num);
+                case VAL_FNUM:  return (left->data.fnum == right->data.fnum);
+                case VAL_BOOL:  return (left->data.fnum == right->data.bval);
+                default:        return 0;
+            }
+        case VAL_BOOL:
+            switch(right->type) {
+                case VAL_NUM:   return (left->data.bval == right->data.num);
+                case VAL_FNUM:  return (left->data.bval == right->data.fnum);
+                case VAL_BOOL:  return (left->data.bval == right->data.bval);
+                default:        return 0;
+            }
+        default: cfgFatalError("invalid left literal type in comp_vals()");
+    }
+
+    return 0;   // can never happen, but the compiler doesn't know it.
+}
+
+static unsigned char is_true(Literal* lit)
+{
+    switch(lit->type) {
+        case VAL_ERROR:
+        case VAL_NAME:
+        case VAL_STR:   return 1;
+        case VAL_NUM:   return lit->data.num == 0? 0: 1;
+        case VAL_FNUM:  return lit->data.fnum != 0.0? 1: 0;
+        case VAL_BOOL:  return lit->data.bval;
+        default: cfgFatalError("invalid literal type in is_true()");
+    }
+
+    return 0; // remove compiler warning.
+}
+
+/*
+ * The result is written into a literal that belongs to the caller. Strings
+ * in it point into the tree.
+ */
+static void eval_expr(InstCtx* ctx, CfgExpr* expr, Literal* result)
+{
+    Literal left, right;
+
+    switch(expr->op) {
+        case EXPR_LIT:
+        case EXPR_FMT:
+            *result = *expr->lit;
+            break;
+        case EXPR_EQ:
+        case EXPR_NEQ:
+            eval_expr(ctx, expr->left, &left);
+            eval_expr(ctx, expr->right, &right);
+            // strings are only substituted when they are compared
+            if(expr->left->op == EXPR_FMT)
+                left.data.str = format_expr(ctx, expr->left, &ctx->fmt[0]);
+            if(expr->right->op == EXPR_FMT)
+                right.data.str = format_expr(ctx, expr->right, &ctx->fmt[1]);
+            result->type = VAL_BOOL;
+            result->data.bval = comp_vals(&left, &right);
+            if(expr->op == EXPR_NEQ)
+                result->data.bval = !result->data.bval;
+            break;
+        case EXPR_NOT:
+            eval_expr(ctx, expr->left, &left);
+            result->type = VAL_BOOL;
+            switch(left.type) {
+                case VAL_ERROR:
+                case VAL_NAME:
+                case VAL_STR:   result->data.bval = 0; break;
+                case VAL_NUM:   result->data.bval = (left.data.num == 0); break;
+                case VAL_FNUM:  result->data.bval = (left.data.fnum == 0.0); break;
+                case VAL_BOOL:  result->data.bval = (left.data.bval == 0)? 1: 0; break;
+                default: cfgFatalError("invalid literal type in eval_expr()");
+            }
+            break;
+        default: cfgFatalError("invalid expression type in eval_expr()");
+    }
+}
+
+static int branch_taken(InstCtx* ctx, CfgNode* branch)
+{
+    Literal result;
+
+    switch(branch->kind) {
+        case BRANCH_IF:
+            eval_expr(ctx, branch->expr, &result);
+            return is_true(&result);
+        case BRANCH_IFDEF:  return find_inst_val(ctx, branch->name) != NULL;
+        case BRANCH_IFNDEF: return find_inst_val(ctx, branch->name) == NULL;
+        case BRANCH_ELSE:   return 1;
+        default: cfgFatalError("invalid branch type: %d", branch->kind);
+    }
+
+    return 0;
+}
+
+static void push_section_name(InstCtx* ctx, const char* name)
+{
+    int len = strlen(name);
+    if(ctx->len+len+2 > ctx->cap) {
+        while(ctx->len+len+2 > ctx->cap)
+            ctx->cap <<= 1;
+        ctx->buf = _realloc_ds_array(ctx->buf, char, ctx->cap);
+    }
+
+    if(ctx->len > 0)
+        ctx->buf[ctx->len++] = '.';
+    strcpy(&ctx->buf[ctx->len], name);
+    ctx->len += len;
+}
+
+static void pop_section_name(InstCtx* ctx, int len)
+{
+    ctx->len = len;
+    ctx->buf[len] = '\0';
+}
+
+static const char* make_var_name(InstCtx* ctx, CfgNode* node)
+{
+    if(ctx->len == 0)
+        cfgFatalError("%d: attempt to create a value outside of a section", node->line_no);
+
+    char* tmp = _alloc(ctx->len+strlen(node->name)+2);
+    strcpy(tmp, ctx->buf);
+    strcat(tmp, ".");
+    strcat(tmp, node->name);
+
+    return tmp;
+}
+
+Literal* copy_literal(Literal* lit)
+{
+    Literal* copy = _alloc_ds(Literal);
+    *copy = *lit;
+    copy->str = _copy_str(lit->str);
+    copy->prev = NULL;
+    copy->next = NULL;
+
+    // the same layout that the scanner makes
+    if(lit->type == VAL_STR)
+        copy->data.str = copy->str;
+    else if(lit->type == VAL_NAME)
+        copy->data.str = _copy_str(lit->data.str);
+
+    return copy;
+}
+
+/*
+ * When the literals are moved, the node is left without any, so the tree
+ * can only be instantiated once.
+ */
+static void add_literals(Value* val, CfgNode* node, int move)
+{
+    Literal* next;
+
+    for(Literal* lit = node->first; lit != NULL; lit = next) {
+        next = lit->next;
+        if(move) {
+            lit->prev = NULL;
+            lit->next = NULL;
+            appendLiteral(val, lit);
+        }
+        else
+            appendLiteral(val, copy_literal(lit));
+    }
+
+    if(move)
+        node->first = node->last = NULL;
+}
+
+static void instantiate_list(InstCtx* ctx, CfgNode* node, int move)
+{
+    for(; node != NULL; node = node->next) {
+        switch(node->type) {
+            case NODE_SECTION: {
+                    int len = ctx->len;
+                    push_section_name(ctx, node->name);
+                    instantiate_list(ctx, node->body, move);
+                    pop_section_name(ctx, len);
+                }
+                break;
+            case NODE_VALUE:
+                add_literals(create_store_val(ctx->store, make_var_name(ctx, node)), node, move);
+                break;
+            case NODE_DEFINE:
+                add_literals(create_store_val(ctx->store, _copy_str(node->name)), node, move);
+                break;
+            case NODE_IF:
+                // the first branch that is taken is the only one
+                for(CfgNode* branch = node->body; branch != NULL; branch = branch->next) {
+                    if(branch_taken(ctx, branch)) {
+                        instantiate_list(ctx, branch->body, move);
+                        break;
+                    }
+                }
+                break;
+            default: cfgFatalError("invalid node type: %d", node->type);
+        }
+    }
+}
+
+/*
+ * Create the values for one top level item in the store. A NULL store is the
+ * global config store.
+ */
+void instantiate_node(CfgNode* node, Value** store, int move)
+{
+    InstCtx ctx;
+    CfgNode* next = node->next;
+
+    ctx.store = store;
+    ctx.cap = 1 << 6;
+    ctx.len = 0;
+    ctx.buf = _alloc_ds_array(char, ctx.cap);
+    ctx.buf[0] = '\0';
+    memset(ctx.fmt, 0, sizeof(ctx.fmt));
+
+    node->next = NULL;
+    instantiate_list(&ctx, node, move);
+    node->next = next;
+
+    _free(ctx.buf);
+    _free(ctx.fmt[0].buf);
+    _free(ctx.fmt[1].buf);
+}
+
+/*
+ * Parse a config file into a tree that keeps all of the conditional branches.
+ * Nothing is added to the config store. Returns NULL if the parse fails.
+ */
+CfgProgram* compileConfig(const char* fname)
+{
+    assert(fname != NULL);
+
+    CfgProgram* prog = _alloc_ds(CfgProgram);
+    prog->items = NULL;
+
+    ParseCtx* ctx = create_parse_ctx(NULL);
+    ctx->program = prog;
+    push_cfg_file(ctx, fname);
+    int retv = parse_cfg(ctx);
+    destroy_parse_ctx(ctx);
+
+    if(retv != 0) {
+        freeConfigProgram(prog);
+        return NULL;
+    }
+
+    return prog;
+}
+
+/*
+ * Add the values in a compiled config to the config store, using whatever is
+ * defined in the store at the time to pick the branches. To build another
+ * profile, call clearConfig(), create the defines for it, and call this again.
+ */
+void instantiateConfig(CfgProgram* prog)
+{
+    assert(prog != NULL);
+
+    for(CfgNode* node = prog->items; node != NULL; node = node->next)
+        instantiate_node(node, NULL, 0);
+}
+
+void freeConfigProgram(CfgProgram* prog)
+{
+    assert(prog != NULL);
+
+    free_node(prog->items);
+    _free(prog);
+}
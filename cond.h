@@ -0,0 +1,75 @@
+#ifndef COND_H
+#define COND_H
+
+#include "values.h"
+
+/*
+ * The parser builds a tree of these for every top level item. Conditionals
+ * are kept as guarded blocks, so the tree can be turned into values for any
+ * set of defines without scanning the text again.
+ */
+#define NODE_SECTION    0   // name and body
+#define NODE_VALUE      1   // name and literals
+#define NODE_DEFINE     2   // name and literal
+#define NODE_IF         3   // body is the list of branches
+#define NODE_BRANCH     4   // one branch of an IF
+
+#define BRANCH_IF       0   // taken if the expression is true
+#define BRANCH_IFDEF    1   // taken if the name is defined
+#define BRANCH_IFNDEF   2   // taken if the name is not defined
+#define BRANCH_ELSE     3   // always taken
+
+#define EXPR_LIT        0
+#define EXPR_EQ         1
+#define EXPR_NEQ        2
+#define EXPR_NOT        3
+#define EXPR_FMT        4   // a string with $(name,index) references in it
+
+/*
+ * A string is split into the text before each reference and the reference,
+ * when the tree is built. The text points into the literal.
+ */
+typedef struct {
+    const char* text;
+    int len;
+    const char* name;   // NULL for the text at the end
+    int index;
+} CfgRef;
+
+typedef struct _cfg_expr {
+    int op;
+    Literal* lit;
+    CfgRef* refs;
+    int count;
+    struct _cfg_expr* left;
+    struct _cfg_expr* right;
+} CfgExpr;
+
+typedef struct _cfg_node {
+    int type;
+    int kind;               // the kind of branch
+    int line_no;
+    const char* name;
+    CfgExpr* expr;
+    Literal* first;
+    Literal* last;
+    struct _cfg_node* body;
+    struct _cfg_node* next;
+    struct _cfg_node* tail; // last one in the list, only kept in the first
+} CfgNode;
+
+struct _cfg_program {
+    CfgNode* items;
+};
+
+CfgNode* create_node(int type, const char* name);
+CfgNode* append_node(CfgNode* list, CfgNode* node);
+void add_node_literal(CfgNode* node, Literal* lit);
+CfgExpr* create_expr(int op, CfgExpr* left, CfgExpr* right, Literal* lit);
+Literal* copy_literal(Literal* lit);
+void free_literal(Literal* lit);
+void free_node(CfgNode* node);
+void free_expr(CfgExpr* expr);
+void instantiate_node(CfgNode* node, Value** store, int move);
+
+#endif
@@ -1,8 +1,385 @@
 
 #include "common.h"
+#include "config.h"
+#include "prescan.h"
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+// files that are smaller than this are not worth splitting
+#define MIN_CHUNK_SIZE (1 << 16)
+
+typedef struct {
+    const char* fname;
+    const char* buf;
+    size_t len;
+    int line_no;
+    Value* frag;
+    ValArray vals;
+    int retv;
+    pthread_t thread;
+} Chunk;
+
+struct _cfg_async {
+    const char* fname;
+    Value* pending;
+    Value* retired;     // values that were replaced while they were published
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t progress;
+    int done;
+    int retv;
+    CfgAsyncCallback callback;
+    void* data;
+};
 
 int readConfig(const char* fname)
 {
-    push_cfg_file(fname);
-    return cfg_parse();
-}
\ No newline at end of file
+    ParseCtx* ctx = create_parse_ctx(NULL);
+    push_cfg_file(ctx, fname);
+    int retv = parse_cfg(ctx);
+    destroy_parse_ctx(ctx);
+
+    return retv;
+}
+
+static char* read_file(const char* fname, size_t* len)
+{
+    FILE* fp = fopen(fname, "r");
+    if(fp == NULL)
+        cfgFatalError("cfg error: cannot open input file: '%s' %s.", fname, strerror(errno));
+
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    char* buf = _alloc(size+1);
+    *len = fread(buf, 1, size, fp);
+    buf[*len] = '\0';
+    fclose(fp);
+
+    return buf;
+}
+
+/*
+ * Each top level item is moved out of the fragment when it is finished, so
+ * the fragment stays small even when the names in the file are in order.
+ */
+static void take_item(ParseCtx* ctx)
+{
+    Chunk* chunk = (Chunk*)ctx->hook_data;
+    take_store_vals(&chunk->vals, &chunk->frag);
+}
+
+static void* parse_chunk(void* ptr)
+{
+    Chunk* chunk = (Chunk*)ptr;
+
+    init_val_array(&chunk->vals);
+    ParseCtx* ctx = create_parse_ctx(&chunk->frag);
+    ctx->item_hook = take_item;
+    ctx->hook_data = chunk;
+    push_cfg_buffer(ctx, chunk->fname, chunk->buf, chunk->len, chunk->line_no);
+    chunk->retv = parse_cfg(ctx);
+
+    // anything that was left by a syntax error
+    take_item(ctx);
+    destroy_parse_ctx(ctx);
+
+    sort_val_array(&chunk->vals);
+
+    return NULL;
+}
+
+/*
+ * Split the buffer into about the given number of chunks, where every chunk
+ * ends at the end of a top level section. Returns the number of chunks, or
+ * zero if the file has to be parsed in order.
+ */
+static int split_chunks(const char* fname, const char* buf, size_t len, Chunk* chunks, int max)
+{
+    Prescan ps;
+    size_t target = len / max;
+    size_t start = 0;
+    size_t idx = 0;
+    int line_no = 1;
+    int sections = 0;
+    int count = 0;
+
+    init_prescan(&ps, 1);
+    while(idx < len) {
+        idx += prescan_next(&ps, &buf[idx], len - idx);
+        if(ps.ordered)
+            return 0;
+
+        if(ps.sections > sections && (idx - start >= target || idx == len) && count < max) {
+            chunks[count].fname = fname;
+            chunks[count].buf = &buf[start];
+            chunks[count].len = idx - start;
+            chunks[count].line_no = line_no;
+            chunks[count].frag = NULL;
+            chunks[count].retv = 0;
+            count++;
+            start = idx;
+            line_no = ps.line_no;
+            sections = ps.sections;
+        }
+    }
+
+    // unterminated quotes or sections are left for the parser to report
+    if(ps.depth != 0 || ps.state == PS_DQUOTE || ps.state == PS_SQUOTE || count == 0)
+        return 0;
+
+    // the sections that did not fill a chunk, and any trailing comments, go
+    // with the last one
+    chunks[count-1].len = len - (chunks[count-1].buf - buf);
+
+    return count;
+}
+
+/*
+ * Read the file and split it the way that readConfigParallel() does. Returns
+ * the number of chunks, or zero if the file is read in order. The buffer and
+ * the chunks belong to the caller.
+ */
+static int plan_chunks(const char* fname, int threads, char** buf, Chunk** chunks)
+{
+    if(threads <= 0)
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    size_t len;
+    *buf = read_file(fname, &len);
+
+    if((size_t)threads > len / MIN_CHUNK_SIZE)
+        threads = len / MIN_CHUNK_SIZE;
+
+    *chunks = NULL;
+    int count = 0;
+    if(threads > 1) {
+        *chunks = _alloc_ds_array(Chunk, threads);
+        count = split_chunks(fname, *buf, len, *chunks, threads);
+    }
+
+    return (count < 2)? 0: count;
+}
+
+/*
+ * Return the number of chunks that readConfigParallel() would parse the file
+ * in, or zero if it would be read in order.
+ */
+int count_parallel_chunks(const char* fname, int threads)
+{
+    assert(fname != NULL);
+
+    char* buf;
+    Chunk* chunks;
+    int count = plan_chunks(fname, threads, &buf, &chunks);
+
+    _free(chunks);
+    _free(buf);
+
+    return count;
+}
+
+/*
+ * Read a configuration file using more than one thread. The file is split
+ * at top level section boundaries and the sections are parsed at the same
+ * time into separate stores that are merged in file order when they are
+ * all finished. If the file uses anything that depends on what came before
+ * it, such as a define, an include, or a conditional, then it is parsed
+ * the same as readConfig(). A thread count of zero uses one per core.
+ */
+int readConfigParallel(const char* fname, int threads)
+{
+    assert(fname != NULL);
+
+    char* buf;
+    Chunk* chunks;
+    int count = plan_chunks(fname, threads, &buf, &chunks);
+
+    if(count == 0) {
+        _free(chunks);
+        _free(buf);
+        return readConfig(fname);
+    }
+
+    for(int i = 1; i < count; i++) {
+        int err = pthread_create(&chunks[i].thread, NULL, parse_chunk, &chunks[i]);
+        if(err != 0)
+            cfgFatalError("cannot create a parser thread: %s", strerror(err));
+    }
+
+    // this thread does the first one
+    parse_chunk(&chunks[0]);
+
+    for(int i = 1; i < count; i++)
+        pthread_join(chunks[i].thread, NULL);
+
+    int retv = 0;
+    ValArray* arrs = _alloc_ds_array(ValArray, count);
+    for(int i = 0; i < count; i++) {
+        arrs[i] = chunks[i].vals;
+        if(retv == 0)
+            retv = chunks[i].retv;
+    }
+    merge_store_vals(arrs, count);
+
+    for(int i = 0; i < count; i++)
+        _free(arrs[i].list);
+    _free(arrs);
+
+    _free(chunks);
+    _free(buf);
+
+    return retv;
+}
+
+/*
+ * Called by the parser when a top level item is finished. The values in it
+ * are published all at once so that a value that is found by a waiting
+ * reader is never half built.
+ */
+static void publish_item(ParseCtx* ctx)
+{
+    CfgAsync* handle = (CfgAsync*)ctx->hook_data;
+
+    if(handle->pending != NULL) {
+        pthread_mutex_lock(&handle->lock);
+        publish_store_vals(handle->pending, &handle->retired);
+        handle->pending = NULL;
+        pthread_cond_broadcast(&handle->progress);
+        pthread_mutex_unlock(&handle->lock);
+    }
+}
+
+static void* parse_async(void* ptr)
+{
+    CfgAsync* handle = (CfgAsync*)ptr;
+
+    ParseCtx* ctx = create_parse_ctx(&handle->pending);
+    ctx->item_hook = publish_item;
+    ctx->hook_data = handle;
+    push_cfg_file(ctx, handle->fname);
+    int retv = parse_cfg(ctx);
+
+    // anything that was left by a syntax error
+    publish_item(ctx);
+    destroy_parse_ctx(ctx);
+
+    pthread_mutex_lock(&handle->lock);
+    handle->retv = retv;
+    handle->done = 1;
+    pthread_cond_broadcast(&handle->progress);
+    pthread_mutex_unlock(&handle->lock);
+
+    if(handle->callback != NULL)
+        (*handle->callback)(handle, retv, handle->data);
+
+    return NULL;
+}
+
+/*
+ * Start reading a configuration file on a background thread and return a
+ * handle to it right away. The kernel is asked to start reading the file in
+ * before the thread gets going. The callback, if there is one, is called on
+ * the background thread when the parse is finished and it must not free the
+ * handle. Until waitConfigAsync() returns, values must be read with
+ * awaitValue() and the store must not be changed. A value that has been
+ * published is never changed by the parse. If a later section adds to it,
+ * then a new value takes its place in the store, and the old one is kept
+ * until freeConfigAsync().
+ */
+CfgAsync* readConfigAsync(const char* fname, CfgAsyncCallback callback, void* data)
+{
+    assert(fname != NULL);
+
+#ifdef POSIX_FADV_WILLNEED
+    int fd = open(fname, O_RDONLY);
+    if(fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        close(fd);
+    }
+#endif
+
+    CfgAsync* handle = _alloc_ds(CfgAsync);
+    handle->fname = _copy_str(fname);
+    handle->pending = NULL;
+    handle->retired = NULL;
+    handle->done = 0;
+    handle->retv = 0;
+    handle->callback = callback;
+    handle->data = data;
+    pthread_mutex_init(&handle->lock, NULL);
+    pthread_cond_init(&handle->progress, NULL);
+
+    int err = pthread_create(&handle->thread, NULL, parse_async, handle);
+    if(err != 0)
+        cfgFatalError("cannot create a parser thread: %s", strerror(err));
+
+    return handle;
+}
+
+/*
+ * Return non-zero if the parse is finished.
+ */
+int pollConfigAsync(CfgAsync* handle)
+{
+    assert(handle != NULL);
+
+    pthread_mutex_lock(&handle->lock);
+    int done = handle->done;
+    pthread_mutex_unlock(&handle->lock);
+
+    return done;
+}
+
+/*
+ * Block until the parse is finished and return what readConfig() would have.
+ */
+int waitConfigAsync(CfgAsync* handle)
+{
+    assert(handle != NULL);
+
+    pthread_mutex_lock(&handle->lock);
+    while(!handle->done)
+        pthread_cond_wait(&handle->progress, &handle->lock);
+    int retv = handle->retv;
+    pthread_mutex_unlock(&handle->lock);
+
+    return retv;
+}
+
+/*
+ * Block until the named value has been parsed, or until the parse is
+ * finished if it is not in the configuration. Returns NULL for the latter.
+ */
+Value* awaitValue(CfgAsync* handle, const char* name)
+{
+    assert(handle != NULL);
+    assert(name != NULL);
+
+    Value* val;
+
+    pthread_mutex_lock(&handle->lock);
+    while(NULL == (val = findValue(name)) && !handle->done)
+        pthread_cond_wait(&handle->progress, &handle->lock);
+    pthread_mutex_unlock(&handle->lock);
+
+    return val;
+}
+
+/*
+ * Wait for the parse to finish and release the handle. The values that were
+ * read stay in the store, but the ones that were replaced are released.
+ */
+void freeConfigAsync(CfgAsync* handle)
+{
+    assert(handle != NULL);
+
+    pthread_join(handle->thread, NULL);
+    free_retired_vals(handle->retired);
+    pthread_mutex_destroy(&handle->lock);
+    pthread_cond_destroy(&handle->progress);
+    _free(handle->fname);
+    _free(handle);
+}
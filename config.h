@@ -4,10 +4,47 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include <stddef.h>
+
 #include "values.h"
+#include "query.h"
+#include "builder.h"
 #include "cmdline.h"
 #include "errors.h"
 
+typedef struct _cfg_async CfgAsync;
+typedef struct _cfg_feed CfgFeed;
+typedef struct _cfg_program CfgProgram;
+typedef void (*CfgAsyncCallback)(CfgAsync* handle, int result, void* data);
+
 int readConfig(const char* fname);
+int readConfigParallel(const char* fname, int threads);
+
+CfgAsync* readConfigAsync(const char* fname, CfgAsyncCallback callback, void* data);
+int pollConfigAsync(CfgAsync* handle);
+int waitConfigAsync(CfgAsync* handle);
+Value* awaitValue(CfgAsync* handle, const char* name);
+void freeConfigAsync(CfgAsync* handle);
+
+CfgProgram* compileConfig(const char* fname);
+void instantiateConfig(CfgProgram* prog);
+void freeConfigProgram(CfgProgram* prog);
+void clearConfig();
+
+CfgFeed* cfgStart(const char* name);
+int cfgFeed(CfgFeed* feed, const char* buf, size_t len);
+int cfgFinish(CfgFeed* feed);
+
+/*
+ * A Value that findValue() returns from an attached image, its literals and
+ * their strings, stay the same until refreshConfig() switches to a new image
+ * or detachConfig() is called. Both of those invalidate all of them. Values
+ * in the global store are not affected.
+ */
+unsigned long publishConfig(const char* name);
+void unpublishConfig(const char* name);
+int attachConfig(const char* name);
+int refreshConfig();
+void detachConfig();
 
 #endif
\ No newline at end of file
@@ -1,9 +1,11 @@
 
 #include "common.h"
 #include <stdarg.h>
+#include <stdatomic.h>
 
-static int errors = 0;
-static int warnings = 0;
+// more than one parse can be running at a time
+static atomic_int errors = 0;
+static atomic_int warnings = 0;
 
 int getCfgErrors()
 {
@@ -39,8 +41,15 @@ void cfgWarning(const char* fmt, ...)
     warnings++;
 }
 
-void cfg_error(const char *s)
+/*
+ * Called by the parser with the location and the scanner, neither of which
+ * are needed because the error is reported against the current input.
+ */
+void cfg_error(void* loc, void* scanner, const char *s)
 {
+    (void)loc;
+    (void)scanner;
+
     fprintf(stderr, "cfg syntax error: %d: %s at \"%s\"\n", get_line_no(), s, get_text());
     errors++;
 }
@@ -5,6 +5,6 @@ int getCfgErrors();
 int getCfgWarnings();
 void cfgFatalError(const char* fmt, ...);
 void cfgWarning(const char* fmt, ...);
-void cfg_error(const char *s);
+void cfg_error(void* loc, void* scanner, const char *s);
 
 #endif
\ No newline at end of file
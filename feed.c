@@ -0,0 +1,143 @@
+
+#include "common.h"
+#include "config.h"
+#include "prescan.h"
+
+/*
+ * Feeding the parser a piece at a time. The bytes are only scanned up to the
+ * last place where the scanner would be between tokens, so a token is never
+ * split across two scanner buffers. The rest is kept until more bytes come
+ * in, which means that only a partial token or string is held between calls.
+ */
+struct _cfg_feed {
+    const char* name;
+    ParseCtx* ctx;
+    cfg_pstate* pstate;
+    Prescan ps;
+
+    // bytes that could not be scanned yet
+    char* pending;
+    size_t len;
+    size_t cap;
+
+    int line_no;    // line number of the first pending byte
+    int status;     // YYPUSH_MORE until the parser is finished
+};
+
+static void add_pending(CfgFeed* feed, const char* buf, size_t len)
+{
+    if(feed->len+len > feed->cap) {
+        while(feed->len+len > feed->cap)
+            feed->cap <<= 1;
+        feed->pending = _realloc_ds_array(feed->pending, char, feed->cap);
+    }
+
+    memcpy(&feed->pending[feed->len], buf, len);
+    feed->len += len;
+}
+
+static void scan_block(CfgFeed* feed, const char* buf, size_t len)
+{
+    YYSTYPE lval;
+    YYLTYPE lloc;
+    int token;
+
+    memset(&lloc, 0, sizeof(YYLTYPE));
+    push_cfg_buffer(feed->ctx, feed->name, buf, len, feed->line_no);
+
+    ParseCtx* prev = set_parse_ctx(feed->ctx);
+    while(feed->status == YYPUSH_MORE &&
+            0 != (token = cfg_lex(&lval, &lloc, feed->ctx->scanner)))
+        feed->status = cfg_push_parse(feed->pstate, token, &lval, &lloc, feed->ctx->scanner);
+    set_parse_ctx(prev);
+}
+
+/*
+ * Start a parse that will be fed by cfgFeed(). The name is only used when
+ * reporting errors.
+ */
+CfgFeed* cfgStart(const char* name)
+{
+    assert(name != NULL);
+
+    CfgFeed* feed = _alloc_ds(CfgFeed);
+    feed->ctx = create_parse_ctx(NULL);
+    feed->pstate = cfg_pstate_new();
+    init_prescan(&feed->ps, 1);
+
+    feed->cap = 1 << 10;
+    feed->len = 0;
+    feed->pending = _alloc_ds_array(char, feed->cap);
+
+    feed->name = _copy_str(name);
+    feed->line_no = 1;
+    feed->status = YYPUSH_MORE;
+
+    return feed;
+}
+
+/*
+ * Parse as much of the bytes as can be, and keep the rest for the next call.
+ * This never waits for input. Returns zero while there are no errors, or
+ * what readConfig() would return once the parse has failed.
+ */
+int cfgFeed(CfgFeed* feed, const char* buf, size_t len)
+{
+    assert(feed != NULL);
+    assert(buf != NULL);
+
+    if(feed->status != YYPUSH_MORE)
+        return feed->status;
+
+    int line_no = feed->line_no;
+    size_t safe = prescan_safe(&feed->ps, buf, len, &line_no);
+
+    if(safe > 0) {
+        if(feed->len > 0) {
+            add_pending(feed, buf, safe);
+            scan_block(feed, feed->pending, feed->len);
+            feed->len = 0;
+        }
+        else
+            scan_block(feed, buf, safe);
+
+        feed->line_no = line_no;
+    }
+
+    add_pending(feed, &buf[safe], len - safe);
+
+    return (feed->status == YYPUSH_MORE)? 0: feed->status;
+}
+
+/*
+ * Parse whatever is left, tell the parser that the input is finished, and
+ * release the feed. Returns what readConfig() would have returned.
+ */
+int cfgFinish(CfgFeed* feed)
+{
+    assert(feed != NULL);
+
+    if(feed->status == YYPUSH_MORE && feed->len > 0)
+        scan_block(feed, feed->pending, feed->len);
+
+    if(feed->status == YYPUSH_MORE) {
+        YYSTYPE lval;
+        YYLTYPE lloc;
+
+        memset(&lval, 0, sizeof(YYSTYPE));
+        memset(&lloc, 0, sizeof(YYLTYPE));
+        ParseCtx* prev = set_parse_ctx(feed->ctx);
+        feed->status = cfg_push_parse(feed->pstate, 0, &lval, &lloc, feed->ctx->scanner);
+        set_parse_ctx(prev);
+    }
+
+    int retv = feed->status;
+
+    cfg_pstate_delete(feed->pstate);
+    destroy_parse_ctx(feed->ctx);
+    _free(feed->pending);
+    _free(feed->name);
+    _free(feed);
+
+    return retv;
+}
@@ -8,281 +8,58 @@
 #define PRN(f, ...)
 #endif
 
-static Value* val;
-static char* sec_buf = NULL;
-static int sec_cap = 1;
-static int sec_len = 0;
-
-typedef struct {
-    unsigned char* stack;
-    int cap;
-    int len;
-} StateStack;
-
-StateStack* sstack = NULL;
-
-#define CREATED 0x00
-#define INUSE   0x01
-#define FINISH  0x02
-#define stateToStr(s) ((s) == CREATED? "CREATED": (s) == INUSE? "INUSE": "FINISH")
-static int get_state()
-{
-    if(sstack->len > 0) {
-        int state = sstack->stack[sstack->len-1];
-        PRN("%d: state: %s\n", get_line_no(), stateToStr(state));
-        return state;
-    }
-    else
-        cfgFatalError("invalid parser state");
-
-    return 0;   // keep the compiler happy
-}
+#define CTX get_parse_ctx(scanner)
 
-static void set_state(unsigned char state)
+/*
+ * Top level items are turned into values as soon as they are parsed, unless
+ * the config is being compiled, in which case they are kept.
+ */
+static void add_item(ParseCtx* ctx, CfgNode* node)
 {
-    PRN("%d: set state: %s\n", get_line_no(), stateToStr(state));
-    if(sstack->len > 0)
-        sstack->stack[sstack->len-1] = state;
-    else
-        cfgFatalError("invalid parser state");
-}
-
-static void push_state()
-{
-    PRN("%d: push state\n", get_line_no());
-    if(sstack != NULL) {
-        if(sstack->len+1 > sstack->cap) {
-            sstack->cap <<= 1;
-            sstack->stack = _realloc_ds_array(sstack->stack, unsigned char, sstack->cap);
-        }
-    }
+    if(ctx->program != NULL)
+        ctx->program->items = append_node(ctx->program->items, node);
     else {
-        sstack = _alloc_ds(StateStack);
-        sstack->len = 0;
-        sstack->cap = 1 << 3;
-        sstack->stack = _alloc_ds_array(unsigned char, sstack->cap);
-    }
-    sstack->stack[sstack->len] = CREATED;
-    sstack->len++;
-}
-
-static void pop_state()
-{
-    PRN("%d: pop state\n", get_line_no());
-    if(sstack->len > 0)
-        sstack->len--;
-    else
-        cfgFatalError("parser state stack under run");
-}
-
-static unsigned char eval_expr(Literal* lit)
-{
-    switch(lit->type) {
-        case VAL_ERROR:
-        case VAL_NAME:
-        case VAL_STR:   return 1;
-        case VAL_NUM:   return lit->data.num == 0? 0: 1;
-        case VAL_FNUM:  return lit->data.fnum != 0.0? 1: 0;
-        case VAL_BOOL:  return lit->data.bval;
-        default: cfgFatalError("invalid literal type in eval_expr()");
-    }
-
-    return 0; // remove compiler warning.
-}
-
-static void push_section_name(const char* name)
-{
-    if(get_state()) {
-        int len = strlen(name);
-        if(sec_len+len+2 > sec_cap) {
-            while(sec_len+len+2 > sec_cap)
-                sec_cap <<= 1;
-            sec_buf = _realloc_ds_array(sec_buf, char, sec_cap);
-        }
-        strcat(sec_buf, ".");
-        strcat(sec_buf, name);
-        sec_len = strlen(sec_buf);
-    }
-}
-
-static void pop_section_name()
-{
-    if(get_state()) {
-        // note that syntax is enforced by the parser
-        if(sec_len > 0) {
-            char* tmp = strrchr(sec_buf, '.');
-            if(tmp != NULL) {
-                *tmp = '\0';
-                sec_len = strlen(sec_buf);
-            }
-        }
-    }
-}
-
-static const char* make_var_name(const char* name)
-{
-    if(sec_buf == NULL) {
-        cfg_error("attempt to create a value outside of a section");
-        exit(1);
-    }
-
-    if(get_state()) {
-        char* tmp = _alloc(strlen(sec_buf)+strlen(name)+2);
-        strcpy(tmp, sec_buf);
-        strcat(tmp, ".");
-        strcat(tmp, name);
-
-        return tmp;
+        instantiate_node(node, ctx->store, 1);
+        free_node(node);
     }
-    return NULL; // keep the compiler happy
 }
 
-static unsigned char comp_vals(Literal* left, Literal* right)
+static void item_done(ParseCtx* ctx)
 {
-    PRN("%d: comp values: (%s)%s == (%s)%s\n",
-            get_line_no(), literalTypeToStr(left->type), left->str,
-            literalTypeToStr(right->type), right->str);
-    switch(left->type) {
-        case VAL_ERROR:
-            switch(right->type) {
-                case VAL_ERROR: return 1;
-                case VAL_NAME:  return 0;
-                case VAL_STR:   return 0;
-                case VAL_NUM:   return 0;
-                case VAL_FNUM:  return 0;
-                case VAL_BOOL:  return 0;
-                default: cfgFatalError("invalid right literal type in comp_nequ()");
-            }
-            break;
-        case VAL_NAME:
-            switch(right->type) {
-                case VAL_ERROR: return 0;
-                case VAL_NAME:
-                    /*printf("(%s)%s == (%s)%s\n",
-                            literalTypeToStr(left->type), left->data.str,
-                            literalTypeToStr(right->type), right->data.str);*/
-                    return (strcmp(left->str, right->str) == 0);
-                case VAL_STR:
-                    /*printf("(%s)%s == (%s)%s\n",
-                            literalTypeToStr(left->type), left->data.str,
-                            literalTypeToStr(right->type), formatStrLiteral(right->data.str));*/
-                    return (strcmp(left->data.str, formatStrLiteral(right->data.str)) == 0);
-                case VAL_NUM:   return 0;
-                case VAL_FNUM:  return 0;
-                case VAL_BOOL:  return 0;
-                default: cfgFatalError("invalid right literal type in comp_nequ()");
-            }
-            break;
-        case VAL_STR:
-            switch(right->type) {
-                case VAL_ERROR: return 0;
-                case VAL_NAME:
-                    /*printf("(%s)%s == (%s)%s\n",
-                            literalTypeToStr(left->type), left->data.str,
-                            literalTypeToStr(right->type), right->data.str);*/
-                    return (strcmp(formatStrLiteral(left->data.str), right->data.str) == 0);
-                case VAL_STR:
-                    /*printf("(%s)%s == (%s)%s\n",
-                            literalTypeToStr(left->type), formatStrLiteral(left->data.str),
-                            literalTypeToStr(right->type), formatStrLiteral(right->data.str));*/
-                    return (strcmp(formatStrLiteral(left->data.str), formatStrLiteral(right->data.str)) == 0);
-                case VAL_NUM:   return 0;
-                case VAL_FNUM:  return 0;
-                case VAL_BOOL:  return 0;
-                default: cfgFatalError("invalid right literal type in comp_nequ()");
-            }
-            break;
-        case VAL_NUM:
-            switch(right->type) {
-                case VAL_ERROR: return 0;
-                case VAL_NAME:  return 0;
-                case VAL_STR:   return 0;
-                case VAL_NUM:   return (left->data.num == right->data.num);
-                case VAL_FNUM:  return (left->data.num == right->data.fnum);
-                case VAL_BOOL:  return (left->data.num == right->data.bval);
-                default: cfgFatalError("invalid right literal type in comp_nequ()");
-            }
-            break;
-        case VAL_FNUM:
-            switch(right->type) {
-                case VAL_ERROR: return 0;
-                case VAL_NAME:  return 0;
-                case VAL_STR:   return 0;
-                case VAL_NUM:   return (left->data.fnum != right->data.num);
-                case VAL_FNUM:  return (left->data.fnum != right->data.fnum);
-                case VAL_BOOL:  return (left->data.fnum != right->data.bval);
-                default: cfgFatalError("invalid right literal type in comp_nequ()");
-            }
-            break;
-        case VAL_BOOL:
-            switch(right->type) {
-                case VAL_ERROR: return 0;
-                case VAL_NAME:  return 0;
-                case VAL_STR:   return 0;
-                case VAL_NUM:   return (left->data.bval != right->data.num);
-                case VAL_FNUM:  return (left->data.bval != right->data.fnum);
-                case VAL_BOOL:  return (left->data.bval != right->data.bval);
-                default: cfgFatalError("invalid right literal type in comp_nequ()");
-            }
-            break;
-        default: cfgFatalError("invalid left literal type in comp_nequ()");
-    }
-
-    return 0;   // can never happen, but the compiler doesn't know it.
+    if(ctx->item_hook != NULL)
+        (*ctx->item_hook)(ctx);
 }
 
-static Literal* comp_equ(Literal* left, Literal* right)
-{
-    //printf("%s == %s\n", literalValToStr(left), literalValToStr(right));
-    Literal* result = _alloc_ds(Literal);
-
-    result->type = VAL_BOOL;
-    result->data.bval = comp_vals(left, right);
-
-    return result;
-}
-
-static Literal* comp_nequ(Literal* left, Literal* right)
-{
-    Literal* result = _alloc_ds(Literal);
-
-    result->type = VAL_BOOL;
-    result->data.bval = comp_vals(left, right) == 0? 1: 0;
-
-    return result;
-}
-
-static Literal* negate_expr(Literal* val)
-{
-    Literal* result = _alloc_ds(Literal);
-
-    result->type = VAL_BOOL;
-    switch(val->type) {
-        case VAL_ERROR:
-        case VAL_NAME:
-        case VAL_STR: result->data.bval = 0; break;
-        case VAL_NUM: result->data.bval = (val->data.num == 0); break;
-        case VAL_FNUM: result->data.bval = (val->data.fnum == 0.0); break;
-        case VAL_BOOL: result->data.bval = (val->data.bval == 0)? 1: 0; break;
-        default: cfgFatalError("invalid literal type in negate_expr()");
-    }
+%}
 
-    return result;
+%code requires {
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void* yyscan_t;
+#endif
 }
 
-%}
-
+%define api.pure full
+%define api.push-pull both
 %define parse.error verbose
 %locations
 %debug
+%lex-param {yyscan_t scanner}
+%parse-param {yyscan_t scanner}
 
 %union {
     Literal* literal;
+    struct _cfg_node* node;
+    struct _cfg_expr* expr;
 };
 
 %token INCLUDE IF ELSE EQ NEQ IFDEF IFNDEF NOT DEFINE
 %token <literal> QSTR NUM FNUM TRUE FALSE NAME
-%type <literal> bool_value value_literal expression
+%type <literal> bool_value value_literal
+%type <expr> expression
+%type <node> value_literal_list define_clause section_clause section_body
+%type <node> section_body_item if_body_list if_intro if_clause
+%type <node> else_intro else_clause else_clause_list
 
 %left EQ NEQ
 %left NEGATE
@@ -290,34 +67,29 @@ static Literal* negate_expr(Literal* val)
 %%
 
 module
-    : {
-        push_state();
-        set_state(INUSE);
-    } module_list {
-        pop_state();
-    }
+    : module_list
     ;
 
 module_list
-    : module_item
-    | module_list module_item
+    : module_item { item_done(CTX); }
+    | module_list module_item { item_done(CTX); }
     ;
 
 module_item
     : include_clause
-    | section_clause
-    | if_clause
-    | define_clause
+    | section_clause { add_item(CTX, $1); }
+    | if_clause { add_item(CTX, $1); }
+    | define_clause { add_item(CTX, $1); }
     ;
 
 include_clause
     : INCLUDE QSTR {
-            if(get_state() == INUSE)
-                push_cfg_file($2->str); // formatting not supported
+            push_cfg_file(CTX, $2->str); // formatting not supported
+            free_literal($2);
         }
     | INCLUDE NAME {
-            if(get_state() == INUSE)
-                push_cfg_file($2->str); // formatting not supported
+            push_cfg_file(CTX, $2->str); // formatting not supported
+            free_literal($2);
         }
     ;
 
@@ -331,31 +103,28 @@ value_literal
 
 value_literal_list
     : value_literal {
-            if(get_state() == INUSE)
-                appendLiteral(val, $1);
+            $$ = create_node(NODE_VALUE, NULL);
+            add_node_literal($$, $1);
         }
     | value_literal_list ':' value_literal {
-            if(get_state() == INUSE)
-                appendLiteral(val, $3);
+            add_node_literal($1, $3);
+            $$ = $1;
         }
     ;
 
 define_clause
     : DEFINE NAME value_literal {
-            if(get_state() == INUSE) {
-                //printf("define %s %s\n", $2->str, $3->str);
-                appendLiteral(createVal($2->str), $3);
-            }
+            $$ = create_node(NODE_DEFINE, $2->str);
+            add_node_literal($$, $3);
+            free_literal($2);
         }
     ;
 
 section_clause
-    : NAME '{' {
-            if(get_state() == INUSE)
-                push_section_name($1->str);
-        } section_body '}' {
-            if(get_state() == INUSE)
-                pop_section_name();
+    : NAME '{' section_body '}' {
+            $$ = create_node(NODE_SECTION, $1->str);
+            $$->body = $3;
+            free_literal($1);
         }
     ;
 
@@ -366,85 +135,85 @@ bool_value
 
 section_body
     : section_body_item
-    | section_body section_body_item
+    | section_body section_body_item { $$ = append_node($1, $2); }
     ;
 
 section_body_item
-    : NAME '=' {
-            if(get_state() == INUSE)
-                val = createVal(make_var_name($1->str));
-        } value_literal_list
+    : NAME '=' value_literal_list {
+            $$ = $3;
+            $$->name = _copy_str($1->str);
+            free_literal($1);
+        }
     | section_clause
     | if_clause
     ;
 
 if_body_list
     : section_body_item
-    | if_body_list section_body_item
+    | if_body_list section_body_item { $$ = append_node($1, $2); }
     ;
 
 if_intro
     : IFDEF NAME '{' {
-            push_state();
-            if(findValue($2->str) != NULL)
-                set_state(INUSE);
+            $$ = create_node(NODE_BRANCH, $2->str);
+            $$->kind = BRANCH_IFDEF;
+            free_literal($2);
         }
     | IFNDEF NAME '{' {
-            push_state();
-            if(findValue($2->str) == NULL)
-                set_state(INUSE);
+            $$ = create_node(NODE_BRANCH, $2->str);
+            $$->kind = BRANCH_IFNDEF;
+            free_literal($2);
         }
     | IF expression '{' {
-            push_state();
-            if(eval_expr($2))
-                set_state(INUSE);
+            $$ = create_node(NODE_BRANCH, NULL);
+            $$->kind = BRANCH_IF;
+            $$->expr = $2;
         }
     ;
 
 if_clause
     : if_intro if_body_list '}' {
-            pop_state();
+            $1->body = $2;
+            $$ = create_node(NODE_IF, NULL);
+            $$->body = $1;
         }
-    | if_intro if_body_list '}' {
-            if(get_state() == INUSE)
-                set_state(FINISH);
-        } else_clause_list {
-            pop_state();
+    | if_intro if_body_list '}' else_clause_list {
+            $1->body = $2;
+            $$ = create_node(NODE_IF, NULL);
+            $$->body = append_node($1, $4);
         }
     ;
 
 else_intro
     : ELSE expression '{' {
-            if(get_state() != FINISH) {
-                if(eval_expr($2))
-                    set_state(INUSE);
-            }
+            $$ = create_node(NODE_BRANCH, NULL);
+            $$->kind = BRANCH_IF;
+            $$->expr = $2;
         }
     | ELSE '{' {
-            if(get_state() != FINISH) {
-                set_state(INUSE);
-            }
+            $$ = create_node(NODE_BRANCH, NULL);
+            $$->kind = BRANCH_ELSE;
         }
     ;
 
 else_clause
     : else_intro if_body_list '}' {
-        if(get_state() == INUSE)
-            set_state(FINISH);
-    }
+            $1->body = $2;
+            $$ = $1;
+        }
     ;
 
 else_clause_list
     : else_clause
-    | else_clause_list else_clause
+    | else_clause_list else_clause { $$ = append_node($1, $2); }
     ;
 
 expression
-    : value_literal
-    | expression EQ expression { $$ = comp_equ($1, $3); }
-    | expression NEQ expression {  $$ = comp_nequ($1, $3); }
+    : value_literal { $$ = create_expr(EXPR_LIT, NULL, NULL, $1); }
+    | expression EQ expression { $$ = create_expr(EXPR_EQ, $1, $3, NULL); }
+    | expression NEQ expression { $$ = create_expr(EXPR_NEQ, $1, $3, NULL); }
     | '(' expression ')' { $$ = $2; }
-    | NOT expression %prec NEGATE { $$ = negate_expr($2); }
+    | NOT expression %prec NEGATE { $$ = create_expr(EXPR_NOT, $2, NULL, NULL); }
     ;
 
 %%
@@ -0,0 +1,145 @@
+
+#include "common.h"
+#include <strings.h>
+#include "prescan.h"
+
+/*
+ * These keywords make the result of the parse depend on what has already
+ * been parsed, so a file that has them cannot be parsed out of order.
+ */
+static const char* ordered_words[] = {
+    "include", "define", "if", "ifdef", "ifndef", "else", NULL
+};
+
+static int is_name_char(int ch)
+{
+    return isalnum(ch) || strchr("_$%&-.", ch) != NULL;
+}
+
+static void check_word(Prescan* ps)
+{
+    if(ps->wlen > 0) {
+        ps->word[ps->wlen] = '\0';
+        for(int i = 0; ordered_words[i] != NULL; i++) {
+            if(!strcasecmp(ps->word, ordered_words[i])) {
+                ps->ordered++;
+                break;
+            }
+        }
+    }
+    ps->wlen = 0;
+}
+
+void init_prescan(Prescan* ps, int line_no)
+{
+    assert(ps != NULL);
+
+    memset(ps, 0, sizeof(Prescan));
+    ps->line_no = line_no;
+    ps->state = PS_TEXT;
+}
+
+// results of a step
+#define PS_CLOSED   0x01    // closed a top level section
+#define PS_BETWEEN  0x02    // the scanner would be between tokens
+
+static int prescan_char(Prescan* ps, int ch)
+{
+    if(ch == '\n')
+        ps->line_no++;
+
+    switch(ps->state) {
+        case PS_TEXT:
+            if(ch != 0 && is_name_char(ch)) {
+                if(ps->wlen >= 0 && ps->wlen < (int)sizeof(ps->word)-1)
+                    ps->word[ps->wlen++] = (char)ch;
+                else
+                    ps->wlen = -1;
+                return 0;
+            }
+
+            check_word(ps);
+            switch(ch) {
+                case '#':  ps->state = PS_COMMENT; return 0;
+                case '\"': ps->state = PS_DQUOTE; return 0;
+                case '\'': ps->state = PS_SQUOTE; return 0;
+                case '{':  ps->depth++; return PS_BETWEEN;
+                case '}':
+                    // unbalanced braces are left for the parser to report
+                    if(ps->depth > 0 && --ps->depth == 0) {
+                        ps->sections++;
+                        return PS_CLOSED | PS_BETWEEN;
+                    }
+                    return PS_BETWEEN;
+                case ' ': case '\t': case '\r': case '\n':
+                case '=': case ':': case '(': case ')':
+                    return PS_BETWEEN;
+            }
+            return 0;
+
+        case PS_COMMENT:
+            if(ch == '\n') {
+                ps->state = PS_TEXT;
+                return PS_BETWEEN;
+            }
+            return 0;
+
+        case PS_DQUOTE:
+        case PS_SQUOTE:
+            if(ps->escape)
+                ps->escape = 0;
+            else if(ch == '\\')
+                ps->escape = 1;
+            else if((ch == '\"' && ps->state == PS_DQUOTE) ||
+                    (ch == '\'' && ps->state == PS_SQUOTE)) {
+                ps->state = PS_TEXT;
+                return PS_BETWEEN;
+            }
+            return 0;
+    }
+
+    return 0;
+}
+
+/*
+ * Scan the buffer up to and including the '}' that closes the next top level
+ * section. Returns the number of bytes that were consumed, which is the
+ * whole buffer if there is no section that closes in it. The state is kept
+ * in the Prescan so scanning can continue where it left off.
+ */
+size_t prescan_next(Prescan* ps, const char* buf, size_t len)
+{
+    assert(ps != NULL);
+    assert(buf != NULL);
+
+    for(size_t idx = 0; idx < len; idx++) {
+        if(prescan_char(ps, (unsigned char)buf[idx]) & PS_CLOSED)
+            return idx+1;
+    }
+
+    return len;
+}
+
+/*
+ * Scan the whole buffer and return the offset just past the last place in it
+ * where the scanner would be between tokens, or zero if there is none. The
+ * text before that can be scanned without seeing the rest of the input. The
+ * line number of that place is stored in safe_line.
+ */
+size_t prescan_safe(Prescan* ps, const char* buf, size_t len, int* safe_line)
+{
+    assert(ps != NULL);
+    assert(buf != NULL);
+
+    size_t safe = 0;
+
+    for(size_t idx = 0; idx < len; idx++) {
+        if(prescan_char(ps, (unsigned char)buf[idx]) & PS_BETWEEN) {
+            safe = idx+1;
+            if(safe_line != NULL)
+                *safe_line = ps->line_no;
+        }
+    }
+
+    return safe;
+}
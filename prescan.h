@@ -0,0 +1,35 @@
+#ifndef PRESCAN_H
+#define PRESCAN_H
+
+#include <stddef.h>
+
+#define PS_TEXT     0
+#define PS_COMMENT  1
+#define PS_DQUOTE   2
+#define PS_SQUOTE   3
+
+/*
+ * A light weight pass over raw configuration text that only tracks enough
+ * of the lexical state to know where the top level sections begin and end.
+ * Quoted strings and comments are skipped so that braces in them are not
+ * counted. This does not replace the scanner and it does not report errors.
+ */
+typedef struct {
+    int depth;          // brace nesting depth
+    int sections;       // number of top level sections that were closed
+    int line_no;        // line number of the current position
+    int state;          // text, comment, or one of the quote states
+    int escape;         // the last character was a back slash in a quote
+    int ordered;        // saw a construct that depends on the parse order
+    char word[8];       // current word, to look for keywords
+    int wlen;           // length of the current word, -1 if it's too long
+} Prescan;
+
+void init_prescan(Prescan* ps, int line_no);
+size_t prescan_next(Prescan* ps, const char* buf, size_t len);
+size_t prescan_safe(Prescan* ps, const char* buf, size_t len, int* safe_line);
+
+// in config.c
+int count_parallel_chunks(const char* fname, int threads);
+
+#endif
@@ -0,0 +1,228 @@
+
+#include "common.h"
+#include "query.h"
+
+/*
+ * A pattern is split into the parts of a name that are separated by '.'. In
+ * a part, '*' matches any number of characters and '?' matches one, but
+ * neither of them will match a '.'. A part that is only "**" matches any
+ * number of whole parts, including none.
+ */
+#define PART_NAME   0   // compared as it is
+#define PART_ANY    1   // "*", any single part
+#define PART_GLOB   2   // has a '*' or a '?' in it
+#define PART_DEEP   3   // "**", any number of parts
+
+typedef struct {
+    int type;
+    const char* str;
+    int len;
+} QueryPart;
+
+struct _cfg_query {
+    char* pattern;
+    QueryPart* parts;
+    int count;
+
+    // the leading part of the pattern that has no wild cards in it
+    int prefix_len;
+
+    // the last result, good until the store changes
+    Value** result;
+    int rcount;
+    int rcap;
+    unsigned long gen;
+    int valid;
+};
+
+static int match_glob(const char* pat, int plen, const char* str, int slen)
+{
+    int p = 0, s = 0;
+    int star = -1, mark = 0;
+
+    while(s < slen) {
+        if(p < plen && (pat[p] == '?' || pat[p] == str[s])) {
+            p++;
+            s++;
+        }
+        else if(p < plen && pat[p] == '*') {
+            star = p++;
+            mark = s;
+        }
+        else if(star >= 0) {
+            p = star + 1;
+            s = ++mark;
+        }
+        else
+            return 0;
+    }
+
+    while(p < plen && pat[p] == '*')
+        p++;
+
+    return p == plen;
+}
+
+static int match_parts(QueryPart* parts, int count, const char* name)
+{
+    if(count == 0)
+        return *name == '\0';
+
+    if(parts->type == PART_DEEP) {
+        // try to match the rest of the pattern at every part of the name
+        for(;;) {
+            if(match_parts(parts+1, count-1, name))
+                return 1;
+            if(*name == '\0')
+                return 0;
+            const char* dot = strchr(name, '.');
+            name = (dot != NULL)? dot+1: name+strlen(name);
+        }
+    }
+
+    if(*name == '\0')
+        return 0;
+
+    const char* dot = strchr(name, '.');
+    int len = (dot != NULL)? (int)(dot - name): (int)strlen(name);
+
+    switch(parts->type) {
+        case PART_NAME:
+            if(len != parts->len || strncmp(name, parts->str, len))
+                return 0;
+            break;
+        case PART_ANY:
+            break;
+        case PART_GLOB:
+            if(!match_glob(parts->str, parts->len, name, len))
+                return 0;
+            break;
+    }
+
+    if(dot == NULL)
+        return match_parts(parts+1, count-1, "");
+    else
+        return match_parts(parts+1, count-1, dot+1);
+}
+
+static void add_result(CfgQuery* query, Value* val)
+{
+    if(query->rcount+1 > query->rcap) {
+        query->rcap <<= 1;
+        query->result = _realloc_ds_array(query->result, Value*, query->rcap);
+    }
+
+    query->result[query->rcount++] = val;
+}
+
+/*
+ * The store is ordered with the smaller names to the right, so this visits
+ * the names in order. Only the sub-trees that can hold a name that starts
+ * with the prefix of the pattern are looked at.
+ */
+static void run_query(CfgQuery* query, Value* tree)
+{
+    if(tree == NULL)
+        return;
+
+    int x = strncmp(tree->name, query->pattern, query->prefix_len);
+
+    if(x >= 0)
+        run_query(query, tree->right);
+
+    if(x == 0 && match_parts(query->parts, query->count, tree->name))
+        add_result(query, tree);
+
+    if(x <= 0)
+        run_query(query, tree->left);
+}
+
+/*
+ * Compile a pattern such as "targets.*.optimize" into a query that can be
+ * run any number of times.
+ */
+CfgQuery* compileQuery(const char* pattern)
+{
+    assert(pattern != NULL);
+
+    CfgQuery* query = _alloc_ds(CfgQuery);
+    query->pattern = _copy_str(pattern);
+
+    query->count = 1;
+    for(const char* tmp = pattern; *tmp != '\0'; tmp++)
+        if(*tmp == '.')
+            query->count++;
+
+    query->parts = _alloc_ds_array(QueryPart, query->count);
+    const char* str = query->pattern;
+    for(int i = 0; i < query->count; i++) {
+        QueryPart* part = &query->parts[i];
+        const char* dot = strchr(str, '.');
+
+        part->str = str;
+        part->len = (dot != NULL)? (int)(dot - str): (int)strlen(str);
+        if(part->len == 1 && str[0] == '*')
+            part->type = PART_ANY;
+        else if(part->len == 2 && str[0] == '*' && str[1] == '*')
+            part->type = PART_DEEP;
+        else if(memchr(str, '*', part->len) || memchr(str, '?', part->len))
+            part->type = PART_GLOB;
+        else
+            part->type = PART_NAME;
+
+        str = (dot != NULL)? dot+1: str+part->len;
+    }
+
+    query->prefix_len = strcspn(query->pattern, "*?");
+
+    // a "**" can match no parts, so "a.**" matches "a", which does not start
+    // with "a.", and the prefix has to stop before the '.'
+    for(int i = 0; i < query->count; i++) {
+        QueryPart* part = &query->parts[i];
+        int start = part->str - query->pattern;
+        if(start + part->len > query->prefix_len) {
+            if(part->type == PART_DEEP)
+                query->prefix_len = (start > 0)? start-1: 0;
+            break;
+        }
+    }
+
+    query->rcap = 1 << 3;
+    query->rcount = 0;
+    query->result = _alloc_ds_array(Value*, query->rcap);
+    query->gen = 0;
+    query->valid = 0;
+
+    return query;
+}
+
+/*
+ * Return the values that match the query, in name order. The array belongs
+ * to the query and it is kept until the store has a value added to it, so
+ * running the same query again is free.
+ */
+Value** runQuery(CfgQuery* query, int* count)
+{
+    assert(query != NULL);
+    assert(count != NULL);
+
+    if(!query->valid || query->gen != get_store_gen()) {
+        query->rcount = 0;
+        run_query(query, get_cfg_store());
+        query->gen = get_store_gen();
+        query->valid = 1;
+    }
+
+    *count = query->rcount;
+    return query->result;
+}
+
+void freeQuery(CfgQuery* query)
+{
+    assert(query != NULL);
+
+    _free(query->parts);
+    _free(query->pattern);
+    _free(query->result);
+    _free(query);
+}
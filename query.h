@@ -0,0 +1,12 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include "values.h"
+
+typedef struct _cfg_query CfgQuery;
+
+CfgQuery* compileQuery(const char* pattern);
+Value** runQuery(CfgQuery* query, int* count);
+void freeQuery(CfgQuery* query);
+
+#endif
@@ -1,23 +1,54 @@
 #ifndef SCANNER_H
 #define SCANNER_H
 
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void* yyscan_t;
+#endif
+
+/*
+ * All of the state that used to be global in the scanner and the parser
+ * lives here so that more than one parse can be active at the same time.
+ * Values that are created by the parser go into the store that is given
+ * when the context is created. A NULL store means the global config store.
+ */
+typedef struct _parse_ctx {
+    yyscan_t scanner;
+    struct _file_stack* file_stack;
+
+    // string literal accumulator used by the scanner
+    char* buffer;
+    int bcap;
+    int blen;
+
+    Value** store;
+
+    // when set, the parser keeps the top level items here
+    struct _cfg_program* program;
+
+    // called at the end of every top level item, when it is set
+    void (*item_hook)(struct _parse_ctx* ctx);
+    void* hook_data;
+} ParseCtx;
+
+ParseCtx* create_parse_ctx(Value** store);
+void destroy_parse_ctx(ParseCtx* ctx);
+ParseCtx* get_parse_ctx(yyscan_t scanner);
+ParseCtx* set_parse_ctx(ParseCtx* ctx);
+int parse_cfg(ParseCtx* ctx);
+
 int get_line_no();
 const char* get_file_name();
-void push_cfg_file(const char* fname);
+void push_cfg_file(ParseCtx* ctx, const char* fname);
+void push_cfg_buffer(ParseCtx* ctx, const char* name, const char* buf, int len, int line_no);
 const char* get_text();
 
 /*
- * Defined by flex. Call one time to isolate a symbol and then use the global
- * symbol struct to access the symbol.
+ * Defined by flex and bison. The scanner is reentrant and the parser is
+ * pure, so the scanner handle is passed around instead of using globals.
  */
-extern int cfg_lex(void);
-extern int cfg_parse(void);
-extern FILE *cfg_in;
+extern int cfg_lex(YYSTYPE* lval, YYLTYPE* lloc, yyscan_t scanner);
+extern int cfg_parse(yyscan_t scanner);
 extern int cfg_debug;
 
-/*
- * Called by parser for syntax error.
- */
-void cfg_syntax(const char *s);
-
-#endif
\ No newline at end of file
+#endif
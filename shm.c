@@ -0,0 +1,466 @@
+
+#include "common.h"
+#include "config.h"
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * A published configuration is a read-only image in a POSIX shared memory
+ * object. Everything in the image refers to everything else by its offset
+ * from the start of the image, so it can be mapped at any address. The
+ * values are stored in name order so they can be found with a binary
+ * search.
+ *
+ * Every time the configuration is published it gets a new generation
+ * number and a new object named "/name.gen". A small control object named
+ * "/name" holds the current generation, so readers can tell when there is
+ * a new one. An old image is unlinked when a new one is published, but the
+ * readers that have it mapped keep it until they refresh.
+ */
+#define IMAGE_MAGIC 0x43464731  // "CFG1"
+
+typedef struct {
+    unsigned int magic;
+    atomic_ulong gen;
+} ShmControl;
+
+typedef struct {
+    unsigned int magic;
+    unsigned int count;     // number of values
+    unsigned long gen;
+    size_t size;            // of the whole image
+} ShmHeader;
+
+typedef struct {
+    size_t name;
+    size_t lits;            // offset of the first literal
+    unsigned int count;     // number of literals
+} ShmValue;
+
+typedef struct {
+    int type;
+    size_t str;
+    union {
+        size_t str;
+        double fnum;
+        long int num;
+        unsigned char bval;
+    } data;
+} ShmLiteral;
+
+typedef struct {
+    char* base;
+    size_t values;
+    size_t lits;
+    size_t strs;
+} ImageWriter;
+
+// the image that this process is reading from, if there is one
+static char* image = NULL;
+static size_t image_size = 0;
+static char* image_name = NULL;
+
+// values that have been read from the image, one slot for each value in it
+static _Atomic(Value*)* image_vals = NULL;
+static unsigned int image_count = 0;
+
+static char* make_shm_name(const char* name, unsigned long gen)
+{
+    int len = snprintf(NULL, 0, "/%s.%lu", name, gen);
+    char* buf = _alloc(len+1);
+    if(gen > 0)
+        sprintf(buf, "/%s.%lu", name, gen);
+    else
+        sprintf(buf, "/%s", name);
+
+    return buf;
+}
+
+static void measure_store(Value* tree, unsigned int* count, size_t* lits, size_t* strs)
+{
+    if(tree == NULL)
+        return;
+
+    (*count)++;
+    *strs += strlen(tree->name) + 1;
+    for(Literal* lit = tree->list->first; lit != NULL; lit = lit->next) {
+        (*lits)++;
+        *strs += strlen(lit->str) + 1;
+        if((lit->type == VAL_STR || lit->type == VAL_NAME) && lit->data.str != lit->str)
+            *strs += strlen(lit->data.str) + 1;
+    }
+
+    measure_store(tree->right, count, lits, strs);
+    measure_store(tree->left, count, lits, strs);
+}
+
+static size_t write_str(ImageWriter* wr, const char* str)
+{
+    size_t offset = wr->strs;
+    size_t len = strlen(str) + 1;
+
+    memcpy(&wr->base[offset], str, len);
+    wr->strs += len;
+
+    return offset;
+}
+
+/*
+ * The store has the smaller names to the right, so this writes them in
+ * order.
+ */
+static void write_store(ImageWriter* wr, Value* tree)
+{
+    if(tree == NULL)
+        return;
+
+    write_store(wr, tree->right);
+
+    ShmValue* sv = (ShmValue*)&wr->base[wr->values];
+    wr->values += sizeof(ShmValue);
+    sv->name = write_str(wr, tree->name);
+    sv->lits = wr->lits;
+    sv->count = 0;
+
+    for(Literal* lit = tree->list->first; lit != NULL; lit = lit->next) {
+        ShmLiteral* sl = (ShmLiteral*)&wr->base[wr->lits];
+        wr->lits += sizeof(ShmLiteral);
+        sv->count++;
+
+        sl->type = lit->type;
+        sl->str = write_str(wr, lit->str);
+        switch(lit->type) {
+            case VAL_STR:
+            case VAL_NAME:
+                sl->data.str = (lit->data.str != lit->str)? write_str(wr, lit->data.str): sl->str;
+                break;
+            case VAL_NUM:   sl->data.num = lit->data.num; break;
+            case VAL_FNUM:  sl->data.fnum = lit->data.fnum; break;
+            case VAL_BOOL:  sl->data.bval = lit->data.bval; break;
+            default:        cfgFatalError("unknown value type: %d", lit->type);
+        }
+    }
+
+    write_store(wr, tree->left);
+}
+
+static ShmControl* map_control(const char* name, int create)
+{
+    char* cname = make_shm_name(name, 0);
+    int fd = shm_open(cname, create? O_RDWR | O_CREAT: O_RDWR, 0644);
+    _free(cname);
+    if(fd < 0)
+        return NULL;
+
+    if(create && ftruncate(fd, sizeof(ShmControl)) < 0)
+        cfgFatalError("cannot size the shared config control: %s", strerror(errno));
+
+    ShmControl* ctl = mmap(NULL, sizeof(ShmControl), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(ctl == MAP_FAILED)
+        return NULL;
+
+    if(create && ctl->magic != IMAGE_MAGIC) {
+        atomic_store(&ctl->gen, 0);
+        ctl->magic = IMAGE_MAGIC;
+    }
+
+    return ctl;
+}
+
+/*
+ * Write the global store into a new shared memory image and make it the
+ * current generation for the name. Returns the new generation number.
+ */
+unsigned long publishConfig(const char* name)
+{
+    assert(name != NULL);
+
+    ShmControl* ctl = map_control(name, 1);
+    if(ctl == NULL)
+        cfgFatalError("cannot open the shared config control for '%s': %s", name, strerror(errno));
+
+    unsigned int count = 0;
+    size_t lits = 0;
+    size_t strs = 0;
+    measure_store(get_cfg_store(), &count, &lits, &strs);
+
+    size_t size = sizeof(ShmHeader) + count * sizeof(ShmValue) + lits * sizeof(ShmLiteral) + strs;
+    unsigned long old_gen = atomic_load(&ctl->gen);
+    unsigned long gen = old_gen + 1;
+
+    char* iname = make_shm_name(name, gen);
+    int fd = shm_open(iname, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0 || ftruncate(fd, size) < 0)
+        cfgFatalError("cannot create the shared config image '%s': %s", iname, strerror(errno));
+
+    char* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(base == MAP_FAILED)
+        cfgFatalError("cannot map the shared config image '%s': %s", iname, strerror(errno));
+
+    ShmHeader* hdr = (ShmHeader*)base;
+    hdr->count = count;
+    hdr->gen = gen;
+    hdr->size = size;
+
+    ImageWriter wr;
+    wr.base = base;
+    wr.values = sizeof(ShmHeader);
+    wr.lits = wr.values + count * sizeof(ShmValue);
+    wr.strs = wr.lits + lits * sizeof(ShmLiteral);
+    write_store(&wr, get_cfg_store());
+
+    // readers check the magic number, so it goes in last
+    atomic_thread_fence(memory_order_release);
+    hdr->magic = IMAGE_MAGIC;
+    munmap(base, size);
+    _free(iname);
+
+    atomic_store(&ctl->gen, gen);
+    munmap(ctl, sizeof(ShmControl));
+
+    // readers that have the old one mapped keep it until they refresh
+    if(old_gen > 0) {
+        char* oname = make_shm_name(name, old_gen);
+        shm_unlink(oname);
+        _free(oname);
+    }
+
+    return gen;
+}
+
+/*
+ * Remove the published image and the control for the name. Readers that
+ * have it mapped can keep using it.
+ */
+void unpublishConfig(const char* name)
+{
+    assert(name != NULL);
+
+    ShmControl* ctl = map_control(name, 0);
+    if(ctl == NULL)
+        return;
+
+    unsigned long gen = atomic_load(&ctl->gen);
+    munmap(ctl, sizeof(ShmControl));
+
+    if(gen > 0) {
+        char* iname = make_shm_name(name, gen);
+        shm_unlink(iname);
+        _free(iname);
+    }
+
+    char* cname = make_shm_name(name, 0);
+    shm_unlink(cname);
+    _free(cname);
+}
+
+// the literals point into the image, so the strings are not freed
+static void free_image_val(Value* val)
+{
+    Literal* next;
+    for(Literal* lit = val->list->first; lit != NULL; lit = next) {
+        next = lit->next;
+        _free(lit);
+    }
+    _free(val->list->num_cache);
+    _free(val->list->fnum_cache);
+    _free(val->list);
+    _free(val->name);
+    _free(val);
+}
+
+static void release_image()
+{
+    if(image_vals != NULL) {
+        for(unsigned int i = 0; i < image_count; i++) {
+            Value* val = atomic_load(&image_vals[i]);
+            if(val != NULL)
+                free_image_val(val);
+        }
+        _free(image_vals);
+        image_vals = NULL;
+        image_count = 0;
+    }
+
+    if(image != NULL) {
+        munmap(image, image_size);
+        image = NULL;
+        image_size = 0;
+    }
+}
+
+static int map_image(const char* name, unsigned long gen)
+{
+    char* iname = make_shm_name(name, gen);
+    int fd = shm_open(iname, O_RDONLY, 0);
+    _free(iname);
+    if(fd < 0)
+        return 0;
+
+    struct stat st;
+    if(fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(ShmHeader)) {
+        close(fd);
+        return 0;
+    }
+
+    char* base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(base == MAP_FAILED)
+        return 0;
+
+    ShmHeader* hdr = (ShmHeader*)base;
+    if(hdr->magic != IMAGE_MAGIC || hdr->size != (size_t)st.st_size) {
+        munmap(base, st.st_size);
+        return 0;
+    }
+    atomic_thread_fence(memory_order_acquire);
+
+    release_image();
+    image = base;
+    image_size = st.st_size;
+    image_count = hdr->count;
+    image_vals = _alloc_ds_array(_Atomic(Value*), image_count+1);
+    for(unsigned int i = 0; i < image_count; i++)
+        atomic_init(&image_vals[i], NULL);
+
+    return 1;
+}
+
+/*
+ * Map the current image that was published under the name. Values that are
+ * not in the global store are then looked up in the image by findValue().
+ * They must be treated as read-only. Any values that were read from an image
+ * that was mapped before are released. Returns non-zero if an image was
+ * mapped.
+ */
+int attachConfig(const char* name)
+{
+    assert(name != NULL);
+
+    ShmControl* ctl = map_control(name, 0);
+    if(ctl == NULL)
+        return 0;
+
+    // the publisher may replace the image between reading the generation
+    // and opening it, so try again with the new one.
+    int mapped = 0;
+    unsigned long gen;
+    do {
+        gen = atomic_load(&ctl->gen);
+        mapped = (gen > 0) && map_image(name, gen);
+    } while(!mapped && gen != atomic_load(&ctl->gen));
+    munmap(ctl, sizeof(ShmControl));
+
+    if(mapped) {
+        _free(image_name);
+        image_name = _copy_str(name);
+    }
+
+    return mapped;
+}
+
+/*
+ * If a new generation has been published, then switch to it. All of the
+ * values that were read from the old image are released, so this should be
+ * called at a time when none of them are in use, and no other thread is
+ * looking up values. Returns non-zero if the image was changed.
+ */
+int refreshConfig()
+{
+    if(image == NULL || image_name == NULL)
+        return 0;
+
+    ShmControl* ctl = map_control(image_name, 0);
+    if(ctl == NULL)
+        return 0;
+
+    unsigned long gen = atomic_load(&ctl->gen);
+    munmap(ctl, sizeof(ShmControl));
+
+    if(gen == ((ShmHeader*)image)->gen)
+        return 0;
+
+    char* name = _copy_str(image_name);
+    int retv = attachConfig(name);
+    _free(name);
+
+    return retv;
+}
+
+void detachConfig()
+{
+    release_image();
+    _free(image_name);
+    image_name = NULL;
+}
+
+static Value* make_image_val(ShmValue* sv)
+{
+    Value* val = create_detached_val(&image[sv->name]);
+    ShmLiteral* sl = (ShmLiteral*)&image[sv->lits];
+
+    for(unsigned int i = 0; i < sv->count; i++, sl++) {
+        Literal* lit = _alloc_ds(Literal);
+        lit->type = sl->type;
+        lit->str = &image[sl->str];
+        lit->prev = NULL;
+        lit->next = NULL;
+        switch(sl->type) {
+            case VAL_STR:
+            case VAL_NAME:  lit->data.str = &image[sl->data.str]; break;
+            case VAL_NUM:   lit->data.num = sl->data.num; break;
+            case VAL_FNUM:  lit->data.fnum = sl->data.fnum; break;
+            case VAL_BOOL:  lit->data.bval = sl->data.bval; break;
+        }
+        appendLiteral(val, lit);
+    }
+
+    return val;
+}
+
+/*
+ * Find a value in the image and copy its list into a private value so that
+ * the rest of the API can use it. The strings are not copied. A value is
+ * only made once for each image, so the same pointer is returned every time
+ * until the image is changed. More than one thread can do this at a time,
+ * and if two of them make the same value, then the one that loses keeps the
+ * one that won.
+ */
+Value* find_image_val(const char* name)
+{
+    if(image == NULL)
+        return NULL;
+
+    ShmValue* values = (ShmValue*)&image[sizeof(ShmHeader)];
+    int low = 0;
+    int high = (int)image_count - 1;
+
+    while(low <= high) {
+        int mid = (low + high) / 2;
+        int x = strcmp(&image[values[mid].name], name);
+        if(x < 0)
+            low = mid + 1;
+        else if(x > 0)
+            high = mid - 1;
+        else {
+            Value* val = atomic_load_explicit(&image_vals[mid], memory_order_acquire);
+            if(val != NULL)
+                return val;
+
+            Value* made = make_image_val(&values[mid]);
+            if(atomic_compare_exchange_strong_explicit(&image_vals[mid], &val, made,
+                        memory_order_acq_rel, memory_order_acquire))
+                return made;
+
+            free_image_val(made);
+            return val;
+        }
+    }
+
+    return NULL;
+}
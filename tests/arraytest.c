@@ -0,0 +1,90 @@
+/*
+ * Check the functions that copy a list into an array of NUMs or FNUMs, and
+ * the cached arrays that belong to a value.
+ */
+#include "testutil.h"
+
+static Value* make_val(const char* name, ValType type, const char** strs, int count)
+{
+    Value* val = createVal(strdup(name));
+    for(int i = 0; i < count; i++)
+        appendLiteral(val, createLiteral(type, strdup(strs[i])));
+
+    return val;
+}
+
+int main()
+{
+    long int nums[8];
+    double fnums[8];
+    int count;
+
+    // a mixed list of FNUM and NUM is widened without a warning
+    CHECK(readConfig("test.cfg") == 0);
+    Value* val = findValue("name2134.some_numbers.number-list");
+    CHECK(val != NULL);
+    int warnings = getCfgWarnings();
+    CHECK(getValueAsFnumArray(val, fnums, 8) == 3);
+    CHECK(fnums[0] == 0.0 && fnums[1] == 100.0 && fnums[2] == 22.0123e2);
+    const double* fcache = getCachedFnumArray(val, &count);
+    CHECK(count == 3 && fcache != NULL);
+    CHECK(fcache[0] == 0.0 && fcache[1] == 100.0 && fcache[2] == 22.0123e2);
+    CHECK(getCachedFnumArray(val, &count) == fcache);
+    CHECK(getCfgWarnings() == warnings);
+
+    // a list that is all NUM is copied from the cache after the first time
+    static const char* strs[] = { "1", "2", "3", "4", "5" };
+    val = make_val("nums", VAL_NUM, strs, 5);
+    const long int* cache = getCachedNumArray(val, &count);
+    CHECK(count == 5 && cache != NULL);
+    CHECK(cache[0] == 1 && cache[4] == 5);
+    CHECK(getCachedNumArray(val, &count) == cache);
+    CHECK(getValueAsNumArray(val, nums, 8) == 5);
+    CHECK(nums[0] == 1 && nums[1] == 2 && nums[2] == 3 && nums[3] == 4 && nums[4] == 5);
+    CHECK(getValueAsFnumArray(val, fnums, 8) == 5);
+    CHECK(fnums[0] == 1.0 && fnums[4] == 5.0);
+    CHECK(getCfgWarnings() == warnings);
+
+    // only max elements are stored, and zero gets the size
+    nums[2] = -1;
+    CHECK(getValueAsNumArray(val, nums, 2) == 5);
+    CHECK(nums[0] == 1 && nums[1] == 2 && nums[2] == -1);
+    fnums[1] = -1.0;
+    CHECK(getValueAsFnumArray(val, fnums, 1) == 5);
+    CHECK(fnums[0] == 1.0 && fnums[1] == -1.0);
+    CHECK(getValueAsNumArray(val, NULL, 0) == 5);
+    CHECK(getValueAsFnumArray(val, NULL, 0) == 5);
+
+    // changing the list releases the caches
+    getCachedFnumArray(val, &count);
+    appendLiteral(val, createLiteral(VAL_NUM, "6"));
+    cache = getCachedNumArray(val, &count);
+    CHECK(count == 6 && cache[5] == 6);
+    fcache = getCachedFnumArray(val, &count);
+    CHECK(count == 6 && fcache[5] == 6.0);
+
+    replaceLiteral(val, createLiteral(VAL_NUM, "10"), 0);
+    cache = getCachedNumArray(val, &count);
+    CHECK(count == 6 && cache[0] == 10);
+    fcache = getCachedFnumArray(val, &count);
+    CHECK(count == 6 && fcache[0] == 10.0);
+    CHECK(getValueAsNumArray(val, nums, 8) == 6);
+    CHECK(nums[0] == 10 && nums[5] == 6);
+
+    // a STR in the list is converted, with one warning for the whole list
+    val = make_val("mixed", VAL_NUM, strs, 2);
+    appendLiteral(val, createLiteral(VAL_STR, strdup("30")));
+    appendLiteral(val, createLiteral(VAL_STR, strdup("40")));
+
+    warnings = getCfgWarnings();
+    CHECK(getValueAsNumArray(val, nums, 8) == 4);
+    CHECK(nums[0] == 1 && nums[1] == 2 && nums[2] == 30 && nums[3] == 40);
+    CHECK(getCfgWarnings() == warnings+1);
+
+    warnings = getCfgWarnings();
+    CHECK(getValueAsFnumArray(val, fnums, 8) == 4);
+    CHECK(fnums[0] == 1.0 && fnums[2] == 30.0 && fnums[3] == 40.0);
+    CHECK(getCfgWarnings() == warnings+1);
+
+    return finish_test("arraytest");
+}
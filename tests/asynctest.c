@@ -0,0 +1,103 @@
+/*
+ * Check that readConfigAsync() picks the same branches as readConfig(), when
+ * a conditional uses a value from earlier in the same top level section, and
+ * that a value can be read while the parse is still using it.
+ */
+#include "testutil.h"
+
+static const char* cfg_text =
+    "define mode fast\n"
+    "sec {\n"
+    "    a = yes\n"
+    "    if \"$(sec.a)\" eq yes {\n"
+    "        b = picked\n"
+    "    }\n"
+    "    else {\n"
+    "        b = missed\n"
+    "    }\n"
+    "    ifdef sec.a {\n"
+    "        c = picked\n"
+    "    }\n"
+    "}\n"
+    "other {\n"
+    "    if \"$(mode)\" eq fast {\n"
+    "        d = picked\n"
+    "    }\n"
+    "}\n";
+
+#define SECTIONS 20000
+
+/*
+ * Every section after the first one substitutes sec.a, and the last one adds
+ * to it, while this thread keeps reading it.
+ */
+static void check_shared_read()
+{
+    char fname[] = "/tmp/asynctestXXXXXX";
+    int fd = mkstemp(fname);
+    CHECK(fd >= 0);
+    FILE* fp = fdopen(fd, "w");
+    fprintf(fp, "sec {\n    a = 1 : 2 : 3 : 4 : 5\n}\n");
+    for(int i = 0; i < SECTIONS; i++)
+        fprintf(fp, "s%d {\n    if \"$(sec.a,2)\" eq \"3\" {\n        x = yes\n    }\n}\n", i);
+    fprintf(fp, "sec {\n    a = 6\n}\n");
+    fclose(fp);
+
+    clearConfig();
+    CfgAsync* handle = readConfigAsync(fname, NULL, NULL);
+    Value* val = awaitValue(handle, "sec.a");
+    CHECK(val != NULL);
+
+    int bad = 0;
+    while(!pollConfigAsync(handle)) {
+        Literal* lit = getLiteral(val, 2);
+        if(lit == NULL || strcmp(lit->str, "3") || getValueCount(val) != 5)
+            bad++;
+    }
+    CHECK(bad == 0);
+    CHECK(waitConfigAsync(handle) == 0);
+
+    // the value that was read is not changed, and the store has the new one
+    CHECK(getValueCount(val) == 5);
+    CHECK(getValueCount(findValue("sec.a")) == 6);
+    CHECK(literal_str("sec.a", 5) != NULL && !strcmp(literal_str("sec.a", 5), "6"));
+    char last[32];
+    snprintf(last, sizeof(last), "s%d.x", SECTIONS-1);
+    CHECK(findValue(last) != NULL);
+
+    freeConfigAsync(handle);
+    unlink(fname);
+}
+
+int main()
+{
+    char fname[] = "/tmp/asynctestXXXXXX";
+    int fd = mkstemp(fname);
+    CHECK(fd >= 0);
+    FILE* fp = fdopen(fd, "w");
+    fputs(cfg_text, fp);
+    fclose(fp);
+
+    CHECK(readConfig(fname) == 0);
+    char* seq = snapshot_store();
+    CHECK(literal_str("sec.b", 0) != NULL && !strcmp(literal_str("sec.b", 0), "picked"));
+
+    clearConfig();
+    CfgAsync* handle = readConfigAsync(fname, NULL, NULL);
+    CHECK(awaitValue(handle, "other.d") != NULL);
+    CHECK(waitConfigAsync(handle) == 0);
+    freeConfigAsync(handle);
+    char* async = snapshot_store();
+
+    CHECK(strcmp(seq, async) == 0);
+    CHECK(literal_str("sec.b", 0) != NULL && !strcmp(literal_str("sec.b", 0), "picked"));
+    CHECK(literal_str("sec.c", 0) != NULL);
+
+    free(seq);
+    free(async);
+    unlink(fname);
+
+    check_shared_read();
+
+    return finish_test("asynctest");
+}
@@ -0,0 +1,124 @@
+/*
+ * Check that the duplicate policies of a builder are applied to every name
+ * that is given more than once, and that the builder owns the strings in the
+ * literals that are given to it.
+ */
+#include "testutil.h"
+
+static char* value_str(const char* name)
+{
+    char* buf = NULL;
+    size_t len = 0;
+    FILE* fp = open_memstream(&buf, &len);
+
+    Value* val = findValue(name);
+    if(val != NULL)
+        for(int i = 0; i < getValueCount(val); i++)
+            fprintf(fp, "%s%s", (i > 0)? " ": "", getLiteral(val, i)->str);
+    fclose(fp);
+
+    return buf;
+}
+
+static int is_value(const char* name, const char* str)
+{
+    char* buf = value_str(name);
+    int retv = !strcmp(buf, str);
+    free(buf);
+
+    return retv;
+}
+
+static void add_names(CfgBuilder* builder, const char** names, int count)
+{
+    for(int i = 0; i < count; i++)
+        builderAdd(builder, names[i], createLiteral(VAL_NAME, names[i]));
+}
+
+int main()
+{
+    char buf[16];
+
+    // the strings are copied, so the caller can change or free them
+    Value* val = createVal(strdup("a.x"));
+    appendLiteral(val, createLiteral(VAL_NUM, "1"));
+    CfgBuilder* builder = createBuilder(CFG_REPLACE);
+    strcpy(buf, "two");
+    builderAdd(builder, "a.x", createLiteral(VAL_STR, buf));
+    builderAdd(builder, "b.y", createLiteral(VAL_STR, "abc"));
+    builderAdd(builder, "b.y", createLiteral(VAL_STR, "def"));
+    strcpy(buf, "gone");
+    CHECK(commitBuilder(builder) == 2);
+    CHECK(is_value("a.x", "two"));
+    CHECK(is_value("b.y", "def"));
+    CHECK(!strcmp(getLiteral(findValue("a.x"), 0)->data.str, "two"));
+
+    // replacing the value again frees the strings that the builder owns
+    builder = createBuilder(CFG_REPLACE);
+    builderAdd(builder, "b.y", createLiteral(VAL_STR, "ghi"));
+    CHECK(commitBuilder(builder) == 1);
+    CHECK(is_value("b.y", "ghi"));
+
+    // calls with the same name are merged by the policy even when they are
+    // one after the other, and the order they were made in is kept
+    clearConfig();
+    builder = createBuilder(CFG_APPEND);
+    builderAdd(builder, "s.c", createLiteral(VAL_NUM, "3"));
+    builderAdd(builder, "s.a", createLiteral(VAL_NUM, "1"));
+    builderAdd(builder, "s.a", createLiteral(VAL_NUM, "2"));
+    builderAdd(builder, "s.b", createLiteral(VAL_NUM, "5"));
+    builderAdd(builder, "s.a", createLiteral(VAL_NUM, "4"));
+    CHECK(commitBuilder(builder) == 2);
+    CHECK(is_value("s.a", "1 2 4"));
+    CHECK(is_value("s.b", "5"));
+    CHECK(is_value("s.c", "3"));
+
+    val = createVal(strdup("p"));
+    appendLiteral(val, createLiteral(VAL_NUM, "1"));
+    builder = createBuilder(CFG_PREPEND);
+    builderAdd(builder, "p", createLiteral(VAL_NUM, "2"));
+    builderAdd(builder, "p", createLiteral(VAL_NUM, "3"));
+    CHECK(commitBuilder(builder) == 2);
+    CHECK(is_value("p", "3 2 1"));
+
+    Literal* lits[3];
+    lits[0] = createLiteral(VAL_NAME, "x");
+    lits[1] = createLiteral(VAL_NAME, "y");
+    lits[2] = createLiteral(VAL_NAME, "z");
+    builder = createBuilder(CFG_REPLACE);
+    builderAddList(builder, "list", lits, 3);
+    CHECK(commitBuilder(builder) == 0);
+    CHECK(is_value("list", "x y z"));
+
+    // the store does not depend on the order of the calls
+    static const char* names[] = {
+        "sec.b.z", "sec.a", "other.q", "sec.b.a", "sec", "abc", "sec.ab", "a",
+        "sec.b.y", "other.p", "sec.aa", "zz.top", "sec.b", "other", "sec.a.b",
+        "b", "sec.b.x", "other.r", "aa", "sec.ba",
+    };
+    int count = sizeof(names) / sizeof(names[0]);
+    const char* reversed[sizeof(names) / sizeof(names[0])];
+    for(int i = 0; i < count; i++)
+        reversed[i] = names[count-1-i];
+
+    clearConfig();
+    builder = createBuilder(CFG_APPEND);
+    add_names(builder, names, count);
+    CHECK(commitBuilder(builder) == 0);
+    char* first = snapshot_store();
+
+    clearConfig();
+    builder = createBuilder(CFG_APPEND);
+    add_names(builder, reversed, count);
+    CHECK(commitBuilder(builder) == 0);
+    char* second = snapshot_store();
+
+    CHECK(strcmp(first, second) == 0);
+    for(int i = 0; i < count; i++)
+        CHECK(is_value(names[i], names[i]));
+
+    free(first);
+    free(second);
+
+    return finish_test("buildertest");
+}
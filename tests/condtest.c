@@ -0,0 +1,139 @@
+/*
+ * Check that conditionals pick the right branches, that the branches that
+ * are not taken create nothing, and that a compiled config can be loaded for
+ * more than one set of defines.
+ */
+#include "testutil.h"
+
+static const char* cmp_text =
+    "if 1.5 eq 1.5 { yes { fnum-eq = 1 } }\n"
+    "if 1.5 eq 2.5 { no { fnum-eq = 1 } }\n"
+    "if 1.5 neq 2.5 { yes { fnum-neq = 1 } }\n"
+    "if 1.5 neq 1.5 { no { fnum-neq = 1 } }\n"
+    "if true eq true { yes { bool-eq = 1 } }\n"
+    "if true eq false { no { bool-eq = 1 } }\n"
+    "if true neq false { yes { bool-neq = 1 } }\n"
+    "if 2 eq 2.0 { yes { mixed-eq = 1 } }\n"
+    "if not (1.5 eq 1.5) { no { not-eq = 1 } }\n"
+    "define a \"x\"\n"
+    "define b \"$(a)y\"\n"
+    "lists { l = 1 : 2 : 3 }\n"
+    "define f 1.5\n"
+    "if \"$(b)\" eq xy { yes { nested = 1 } }\n"
+    "if \"<$(lists.l,2)$(a)>\" eq \"<3x>\" { yes { index = 1 } }\n"
+    "if \"$(f)\" eq \"1.500000\" { yes { fnum-str = 1 } }\n"
+    "if \"$(nope)\" eq \"$(nope,0)\" { yes { missing = 1 } }\n"
+    "if \"$(a)\" neq \"$(a)\" { no { same = 1 } }\n";
+
+static const char* prof_text =
+    "if \"$(mode)\" eq \"fast\" {\n"
+    "    build { mode = fast }\n"
+    "}\n"
+    "else {\n"
+    "    build { mode = \"$(mode)\" }\n"
+    "}\n"
+    "ifdef fast {\n"
+    "    build { opt = 3 }\n"
+    "}\n"
+    "else {\n"
+    "    build { opt = 0 }\n"
+    "}\n"
+    "build {\n"
+    "    ifndef fast { debug = yes }\n"
+    "}\n";
+
+static int query_count(const char* pattern)
+{
+    CfgQuery* query = compileQuery(pattern);
+    int count;
+    runQuery(query, &count);
+    freeQuery(query);
+
+    return count;
+}
+
+static int is_str(const char* name, const char* str)
+{
+    const char* val = literal_str(name, 0);
+    return val != NULL && !strcmp(val, str);
+}
+
+static void write_file(char* fname, const char* text)
+{
+    int fd = mkstemp(fname);
+    CHECK(fd >= 0);
+    FILE* fp = fdopen(fd, "w");
+    fputs(text, fp);
+    fclose(fp);
+}
+
+int main()
+{
+    // only the "yes" sections are created
+    CHECK(readConfig("if_test.cfg") == 0);
+    CHECK(query_count("yes-section.*") == 4);
+    CHECK(findValue("yes-section.yes-var11") != NULL);
+    CHECK(findValue("yes-section.yes-var12") != NULL);
+    CHECK(findValue("yes-section.yes-var13") != NULL);
+    CHECK(findValue("yes-section.yes-var14") != NULL);
+    CHECK(query_count("no-section.**") == 0);
+
+    // nothing inside a branch that is not taken is created, including the
+    // branches that are nested in it
+    clearConfig();
+    CHECK(readConfig("test.cfg") == 0);
+    CHECK(query_count("another-section.**") == 0);
+    CHECK(findValue("another-section.value23") == NULL);
+    CHECK(is_str("name2134.label", "val"));
+    CHECK(is_str("special.ksdjdf", "forking"));
+
+    char cmp_name[] = "/tmp/condtestXXXXXX";
+    write_file(cmp_name, cmp_text);
+    clearConfig();
+    CHECK(readConfig(cmp_name) == 0);
+    CHECK(findValue("yes.fnum-eq") != NULL);
+    CHECK(findValue("yes.fnum-neq") != NULL);
+    CHECK(findValue("yes.bool-eq") != NULL);
+    CHECK(findValue("yes.bool-neq") != NULL);
+    CHECK(findValue("yes.mixed-eq") != NULL);
+    CHECK(findValue("yes.nested") != NULL);
+    CHECK(findValue("yes.index") != NULL);
+    CHECK(findValue("yes.fnum-str") != NULL);
+    CHECK(findValue("yes.missing") != NULL);
+    CHECK(query_count("no.**") == 0);
+    unlink(cmp_name);
+
+    // the same compiled config, loaded for two sets of defines
+    char prof_name[] = "/tmp/condtestXXXXXX";
+    write_file(prof_name, prof_text);
+    clearConfig();
+    CfgProgram* prog = compileConfig(prof_name);
+    CHECK(prog != NULL);
+    CHECK(findValue("build.opt") == NULL);
+
+    instantiateConfig(prog);
+    CHECK(is_str("build.opt", "0"));
+    CHECK(is_str("build.debug", "yes"));
+
+    clearConfig();
+    Value* val = createVal(strdup("fast"));
+    appendLiteral(val, createLiteral(VAL_BOOL, "true"));
+    val = createVal(strdup("mode"));
+    appendLiteral(val, createLiteral(VAL_NAME, "fast"));
+    instantiateConfig(prog);
+    CHECK(is_str("build.opt", "3"));
+    CHECK(findValue("build.debug") == NULL);
+    CHECK(is_str("build.mode", "fast"));
+
+    clearConfig();
+    val = createVal(strdup("mode"));
+    appendLiteral(val, createLiteral(VAL_NAME, "slow"));
+    instantiateConfig(prog);
+    CHECK(is_str("build.opt", "0"));
+    CHECK(is_str("build.mode", "$(mode)"));
+
+    freeConfigProgram(prog);
+    unlink(prof_name);
+
+    return finish_test("condtest");
+}
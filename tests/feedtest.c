@@ -0,0 +1,168 @@
+/*
+ * Check that a config that is fed to the parser in pieces gives the same
+ * store as readConfig(), however the bytes are split up. Syntax errors have
+ * to be reported on the same line.
+ */
+#include "testutil.h"
+
+static const char* files[] = {
+    "test.cfg", "if_test.cfg", "ifdef_test.cfg", "incl_test.cfg", "incl_file.cfg", NULL
+};
+
+// things that a split in the wrong place would break
+static const char* tricky_text =
+    "# a comment with a \"quote, a 'quote and a } brace\n"
+    "define base \"a \\\"quoted\\\" } value\\n\\x41\\101 # not a comment\"\n"
+    "define IFfy 12\n"
+    "define NOTHING 0x1F\n"
+    "sec {\n"
+    "    hex = 0x1F : -12.5e3 : .5 : 12345678901\n"
+    "    sq = 'single \\' } # not a comment\n"
+    "line two'\n"
+    "    multi = \"first\n"
+    "        second\"\n"
+    "    flag = on : OFF : True\n"
+    "    ifdef base { inner { z = 1 } } else { inner { z = 2 } }\n"
+    "}\n"
+    "if \"$(base)\" neq x { sec2 { w = TRUE } }\n"
+    "ifndef IFfy { sec3 { v = 1 } } else { sec3 { v = 2 } }\n";
+
+static const char* broken_text = "\n\nbroken {\n    = value\n}\n";
+
+static char* read_file(const char* fname, size_t* len)
+{
+    FILE* fp = fopen(fname, "r");
+    if(fp == NULL) {
+        perror(fname);
+        exit(1);
+    }
+
+    fseek(fp, 0, SEEK_END);
+    *len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    char* buf = malloc(*len+1);
+    *len = fread(buf, 1, *len, fp);
+    fclose(fp);
+
+    return buf;
+}
+
+/*
+ * The store and whatever was reported, after reading the file in one of the
+ * ways. A step of zero is readConfig(), a step less than zero is random sized
+ * pieces up to -step, and anything else is pieces of that size.
+ */
+static char* run_parse(const char* fname, int step, int* retv)
+{
+    char* out = NULL;
+    size_t olen = 0;
+
+    clearConfig();
+    fflush(stderr);
+    int saved = dup(2);
+    FILE* err = tmpfile();
+    dup2(fileno(err), 2);
+
+    if(step == 0)
+        *retv = readConfig(fname);
+    else {
+        size_t len;
+        char* buf = read_file(fname, &len);
+        CfgFeed* feed = cfgStart(fname);
+
+        for(size_t idx = 0; idx < len; ) {
+            size_t size = (step > 0)? (size_t)step: (size_t)(rand() % -step) + 1;
+            if(idx + size > len)
+                size = len - idx;
+            cfgFeed(feed, &buf[idx], size);
+            idx += size;
+        }
+
+        *retv = cfgFinish(feed);
+        free(buf);
+    }
+
+    fflush(stderr);
+    dup2(saved, 2);
+    close(saved);
+
+    FILE* fp = open_memstream(&out, &olen);
+    char* store = snapshot_store();
+    fprintf(fp, "%s", store);
+    free(store);
+
+    rewind(err);
+    int ch;
+    while(EOF != (ch = fgetc(err)))
+        fputc(ch, fp);
+    fclose(err);
+    fclose(fp);
+
+    return out;
+}
+
+static void check_file(const char* fname)
+{
+    int expect_retv;
+    char* expect = run_parse(fname, 0, &expect_retv);
+
+    int steps[] = { 1, 2, 3, 7, 64, 4096, -5, -17, -97 };
+    for(size_t i = 0; i < sizeof(steps)/sizeof(steps[0]); i++) {
+        int rounds = (steps[i] < 0)? 10: 1;
+        for(int r = 0; r < rounds; r++) {
+            int retv;
+            char* result = run_parse(fname, steps[i], &retv);
+            if(retv != expect_retv || strcmp(result, expect)) {
+                fprintf(stderr, "%s: feeding with step %d does not match readConfig()\n", fname, steps[i]);
+                failures++;
+            }
+            free(result);
+        }
+    }
+
+    free(expect);
+}
+
+static void write_file(const char* fname, const char* text, const char* more)
+{
+    FILE* fp = fopen(fname, "w");
+    fputs(text, fp);
+    if(more != NULL)
+        fputs(more, fp);
+    fclose(fp);
+}
+
+int main()
+{
+    srand(1234);
+
+    for(int i = 0; files[i] != NULL; i++)
+        check_file(files[i]);
+
+    char fname[] = "/tmp/feedtestXXXXXX";
+    close(mkstemp(fname));
+
+    write_file(fname, tricky_text, NULL);
+    check_file(fname);
+
+    // make sure the tricky parts really are in the store
+    int retv;
+    free(run_parse(fname, 1, &retv));
+    CHECK(retv == 0);
+    CHECK(literal_str("sec.multi", 0) != NULL && !strcmp(literal_str("sec.multi", 0), "first        second"));
+    CHECK(literal_str("sec.inner.z", 0) != NULL && !strcmp(literal_str("sec.inner.z", 0), "1"));
+    CHECK(literal_str("sec2.w", 0) != NULL);
+    CHECK(literal_str("sec3.v", 0) != NULL && !strcmp(literal_str("sec3.v", 0), "2"));
+    CHECK(findValue("sec.hex") != NULL && getValueCount(findValue("sec.hex")) == 4);
+
+    // the error has to be reported on the same line
+    write_file(fname, tricky_text, broken_text);
+    check_file(fname);
+    free(run_parse(fname, 3, &retv));
+    CHECK(retv != 0);
+
+    unlink(fname);
+
+    return finish_test("feedtest");
+}
@@ -0,0 +1,84 @@
+/*
+ * Check that readConfigParallel() makes the same store as readConfig(), and
+ * that a file that has to be read in order is.
+ */
+#include "testutil.h"
+#include "prescan.h"
+
+#define SECTIONS 3000
+
+// more than MIN_CHUNK_SIZE in config.c, so that the file is really split
+static void write_sections(FILE* fp)
+{
+    for(int i = 0; i < SECTIONS; i++) {
+        fprintf(fp, "sec%d {\n", i);
+        fprintf(fp, "    # a comment with a } in it\n");
+        fprintf(fp, "    name = value%d\n", i);
+        fprintf(fp, "    list = %d : 1.5 : 'single } quoted' : true\n", i);
+        fprintf(fp, "    inner {\n");
+        fprintf(fp, "        str = \"escaped \\\" and } brace $(sec0.name)\"\n");
+        fprintf(fp, "    }\n");
+        fprintf(fp, "}\n\n");
+    }
+}
+
+static char* read_both(const char* fname, char** parallel)
+{
+    clearConfig();
+    CHECK(readConfig(fname) == 0);
+    char* seq = snapshot_store();
+
+    clearConfig();
+    CHECK(readConfigParallel(fname, 4) == 0);
+    *parallel = snapshot_store();
+
+    return seq;
+}
+
+int main()
+{
+    char fname[] = "/tmp/paralleltestXXXXXX";
+    int fd = mkstemp(fname);
+    CHECK(fd >= 0);
+
+    // only sections, so it is split. The ones at the end add to sections in
+    // the first part of the file, and to one of their own.
+    FILE* fp = fdopen(fd, "w");
+    write_sections(fp);
+    fprintf(fp, "sec0 {\n    name = again\n}\n");
+    fprintf(fp, "sec1 {\n    name = again\n}\n");
+    fprintf(fp, "sec0 {\n    name = last\n}\n");
+    fclose(fp);
+
+    CHECK(count_parallel_chunks(fname, 4) > 1);
+
+    char* par;
+    char* seq = read_both(fname, &par);
+    CHECK(strcmp(seq, par) == 0);
+    CHECK(findValue("sec2999.inner.str") != NULL);
+    CHECK(literal_str("sec0.name", 1) != NULL && !strcmp(literal_str("sec0.name", 1), "again"));
+    CHECK(literal_str("sec0.name", 2) != NULL && !strcmp(literal_str("sec0.name", 2), "last"));
+    free(seq);
+    free(par);
+
+    // the conditional at the end depends on the define at the start, so the
+    // file must not be split
+    fp = fopen(fname, "w");
+    fprintf(fp, "define mode fast\n");
+    write_sections(fp);
+    fprintf(fp, "if \"$(mode)\" eq fast {\n    last { picked = yes }\n}\n");
+    fprintf(fp, "else {\n    last { picked = no }\n}\n");
+    fclose(fp);
+
+    CHECK(count_parallel_chunks(fname, 4) == 0);
+
+    seq = read_both(fname, &par);
+    CHECK(strcmp(seq, par) == 0);
+    CHECK(literal_str("last.picked", 0) != NULL && !strcmp(literal_str("last.picked", 0), "yes"));
+    free(seq);
+    free(par);
+
+    unlink(fname);
+
+    return finish_test("paralleltest");
+}
@@ -0,0 +1,46 @@
+/*
+ * Run a few name patterns against a small store and check what they find.
+ */
+#include "testutil.h"
+
+static const char* names[] = {
+    "a", "a.x", "a.b.x", "ab.x", "b.x", "bb", "cbd", "x", NULL
+};
+
+// the names that are found, in order, separated by spaces
+static void check_query(const char* pattern, const char* expect)
+{
+    char buf[256] = "";
+    int count;
+
+    CfgQuery* query = compileQuery(pattern);
+    Value** vals = runQuery(query, &count);
+    for(int i = 0; i < count; i++) {
+        if(i > 0)
+            strcat(buf, " ");
+        strcat(buf, vals[i]->name);
+    }
+    freeQuery(query);
+
+    if(strcmp(buf, expect)) {
+        fprintf(stderr, "pattern '%s' found '%s', expected '%s'\n", pattern, buf, expect);
+        failures++;
+    }
+}
+
+int main()
+{
+    for(int i = 0; names[i] != NULL; i++)
+        createVal(strdup(names[i]));
+
+    check_query("*.x", "a.x ab.x b.x");
+    check_query("a.**", "a a.b.x a.x");
+    check_query("?b*", "bb cbd");
+    check_query("**.x", "a.b.x a.x ab.x b.x x");
+    check_query("a.*.x", "a.b.x");
+    check_query("a.**.x", "a.b.x a.x");
+    check_query("a", "a");
+    check_query("z.**", "");
+
+    return finish_test("querytest");
+}
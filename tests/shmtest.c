@@ -0,0 +1,188 @@
+/*
+ * Check that values read from a published image are the same as the ones
+ * that were published, that threads looking them up at the same time all
+ * get the same value, and that another process can read the image and move
+ * to a new one.
+ */
+#include <pthread.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "testutil.h"
+
+#define THREADS 8
+
+static char** names;
+static int count;
+static Value** found[THREADS];
+
+static void* lookup(void* arg)
+{
+    Value** vals = arg;
+
+    for(int i = 0; i < count; i++)
+        vals[i] = findValue(names[i]);
+
+    return NULL;
+}
+
+static char* value_str(Value* val)
+{
+    char* buf = NULL;
+    size_t len = 0;
+    FILE* fp = open_memstream(&buf, &len);
+
+    for(int i = 0; i < getValueCount(val); i++) {
+        Literal* lit = getLiteral(val, i);
+        fprintf(fp, " (%s)%s", literalTypeToStr(lit->type), lit->str);
+    }
+    fclose(fp);
+
+    return buf;
+}
+
+/*
+ * The child reads the image that the parent published, keeps it while the
+ * parent publishes a new one and unlinks it, and then moves to the new one.
+ */
+static void check_processes(const char* name, char** expect)
+{
+    int to_child[2];
+    int to_parent[2];
+    char ch = 'x';
+
+    CHECK(pipe(to_child) == 0 && pipe(to_parent) == 0);
+    CHECK(readConfig("test.cfg") == 0);
+    unsigned long gen = publishConfig(name);
+    CHECK(gen > 0);
+
+    pid_t pid = fork();
+    CHECK(pid >= 0);
+    if(pid == 0) {
+        // only the image has the values in this process
+        clearConfig();
+        CHECK(attachConfig(name));
+        for(int i = 0; i < count; i++) {
+            Value* val = findValue(names[i]);
+            CHECK(val != NULL);
+            if(val != NULL) {
+                char* str = value_str(val);
+                CHECK(strcmp(str, expect[i]) == 0);
+                free(str);
+            }
+        }
+        CHECK(write(to_parent[1], &ch, 1) == 1);
+        CHECK(read(to_child[0], &ch, 1) == 1);
+
+        // the old image is unlinked, but it is still mapped here
+        char iname[128];
+        snprintf(iname, sizeof(iname), "/%s.%lu", name, gen);
+        int fd = shm_open(iname, O_RDONLY, 0);
+        CHECK(fd < 0 && errno == ENOENT);
+        Value* val = findValue(names[count-1]);
+        CHECK(val != NULL && getLiteral(val, 0) != NULL);
+        if(val != NULL) {
+            char* str = value_str(val);
+            CHECK(strcmp(str, expect[count-1]) == 0);
+            free(str);
+        }
+
+        CHECK(refreshConfig());
+        CHECK(literal_str("extra.key", 0) != NULL && !strcmp(literal_str("extra.key", 0), "hello"));
+        CHECK(findValue(names[0]) == NULL);
+        CHECK(!refreshConfig());
+        detachConfig();
+
+        _exit(failures? 1: 0);
+    }
+
+    CHECK(read(to_parent[0], &ch, 1) == 1);
+    clearConfig();
+    Value* val = createVal(strdup("extra.key"));
+    appendLiteral(val, createLiteral(VAL_NAME, "hello"));
+    CHECK(publishConfig(name) == gen+1);
+    CHECK(write(to_child[1], &ch, 1) == 1);
+
+    int status;
+    CHECK(waitpid(pid, &status, 0) == pid);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    unpublishConfig(name);
+    clearConfig();
+    close(to_child[0]);
+    close(to_child[1]);
+    close(to_parent[0]);
+    close(to_parent[1]);
+}
+
+int main()
+{
+    char name[64];
+    snprintf(name, sizeof(name), "shmtest%d", (int)getpid());
+
+    CHECK(readConfig("test.cfg") == 0);
+
+    CfgQuery* query = compileQuery("**");
+    Value** vals = runQuery(query, &count);
+    names = malloc(count * sizeof(char*));
+    char** expect = malloc(count * sizeof(char*));
+    for(int i = 0; i < count; i++) {
+        names[i] = strdup(vals[i]->name);
+        expect[i] = value_str(vals[i]);
+    }
+    freeQuery(query);
+
+    CHECK(publishConfig(name) > 0);
+    clearConfig();
+    CHECK(attachConfig(name));
+
+    pthread_t tids[THREADS];
+    for(int i = 0; i < THREADS; i++) {
+        found[i] = malloc(count * sizeof(Value*));
+        pthread_create(&tids[i], NULL, lookup, found[i]);
+    }
+    for(int i = 0; i < THREADS; i++)
+        pthread_join(tids[i], NULL);
+
+    for(int i = 0; i < count; i++) {
+        CHECK(found[0][i] != NULL);
+        for(int j = 1; j < THREADS; j++)
+            CHECK(found[j][i] == found[0][i]);
+        CHECK(findValue(names[i]) == found[0][i]);
+        if(found[0][i] != NULL) {
+            char* str = value_str(found[0][i]);
+            CHECK(strcmp(str, expect[i]) == 0);
+            free(str);
+        }
+    }
+    CHECK(findValue("no.such.value") == NULL);
+
+    // a new generation replaces the values that were read before, and this
+    // one only has the new value in it
+    Value* val = createVal(strdup("extra.key"));
+    appendLiteral(val, createLiteral(VAL_NAME, "hello"));
+    CHECK(publishConfig(name) > 0);
+    clearConfig();
+    CHECK(refreshConfig());
+    CHECK(literal_str("extra.key", 0) != NULL && !strcmp(literal_str("extra.key", 0), "hello"));
+    CHECK(findValue(names[0]) == NULL);
+
+    detachConfig();
+    unpublishConfig(name);
+    CHECK(findValue("extra.key") == NULL);
+
+    snprintf(name, sizeof(name), "shmtest%d.fork", (int)getpid());
+    check_processes(name, expect);
+
+    for(int i = 0; i < count; i++) {
+        free(names[i]);
+        free(expect[i]);
+    }
+    for(int i = 0; i < THREADS; i++)
+        free(found[i]);
+    free(names);
+    free(expect);
+
+    return finish_test("shmtest");
+}
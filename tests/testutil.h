@@ -0,0 +1,71 @@
+/*
+ * Small helpers that are shared by the test programs.
+ */
+#ifndef TESTUTIL_H
+#define TESTUTIL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "config.h"
+
+static int failures = 0;
+
+#define CHECK(c) do { \
+        if(!(c)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #c); \
+            failures++; \
+        } \
+    } while(0)
+
+/*
+ * Write every value in the store, in name order, into a string that can be
+ * compared with strcmp(). The raw text of the literals is used, so nothing
+ * is substituted.
+ */
+static inline char* snapshot_store()
+{
+    char* buf = NULL;
+    size_t len = 0;
+    FILE* fp = open_memstream(&buf, &len);
+
+    CfgQuery* query = compileQuery("**");
+    int count;
+    Value** vals = runQuery(query, &count);
+    for(int i = 0; i < count; i++) {
+        fprintf(fp, "%s:", vals[i]->name);
+        resetValIndex(vals[i]);
+        Literal* lit;
+        while(NULL != (lit = iterateVal(vals[i])))
+            fprintf(fp, " (%s)%s", literalTypeToStr(lit->type), lit->str);
+        fprintf(fp, "\n");
+    }
+    freeQuery(query);
+    fclose(fp);
+
+    return buf;
+}
+
+static inline const char* literal_str(const char* name, int index)
+{
+    Value* val = findValue(name);
+    if(val == NULL)
+        return NULL;
+
+    Literal* lit = getLiteral(val, index);
+    return (lit != NULL)? lit->str: NULL;
+}
+
+static inline int finish_test(const char* name)
+{
+    if(failures)
+        printf("%s: %d checks failed\n", name, failures);
+    else
+        printf("%s: passed\n", name);
+
+    return failures? 1: 0;
+}
+
+#endif
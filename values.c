@@ -3,6 +3,7 @@
 #include <stdarg.h>
 
 static Value* cfg_store = NULL;
+static unsigned long store_gen = 0;    // changes when a value is added
 
 typedef struct {
     char* buf;
@@ -70,26 +71,29 @@ static str_t* create_str(const char* str)
     return s;
 }
 
-static void add_value(Value* tree, Value* node)
+/*
+ * Returns the value that is already in the tree with the same name, or NULL
+ * if the node was added.
+ */
+static Value* add_value(Value* tree, Value* node)
 {
     int x = strcmp(tree->name, node->name);
     if(x > 0) {
         if(tree->right != NULL)
-            add_value(tree->right, node);
+            return add_value(tree->right, node);
         else
             tree->right = node;
     }
     else if(x < 0) {
         if(tree->left != NULL)
-            add_value(tree->left, node);
+            return add_value(tree->left, node);
         else
             tree->left = node;
     }
-    else {
-        // This is an error. The value already exists. For now, simply kill the program.
-        fprintf(stderr, "cfg warning: node already exists in the configuration table.\n");
-        exit(1);
-    }
+    else
+        return tree;
+
+    return NULL;
 }
 
 static Value* find_value(Value* tree, const char* key)
@@ -112,6 +116,21 @@ static Value* find_value(Value* tree, const char* key)
     }
 }
 
+#define TYPE_BIT(t) (1u << (t))
+
+static void release_caches(LiteralList* list)
+{
+    if(list->num_cache != NULL) {
+        _free(list->num_cache);
+        list->num_cache = NULL;
+    }
+
+    if(list->fnum_cache != NULL) {
+        _free(list->fnum_cache);
+        list->fnum_cache = NULL;
+    }
+}
+
 static void append_val_entry(Value* val, Literal* ve)
 {
     //printf("val:%s, lit:%s\n", val->name, ve->str);
@@ -124,6 +143,9 @@ static void append_val_entry(Value* val, Literal* ve)
         list->first = ve;
 
     list->last = ve;
+    list->count++;
+    list->types |= TYPE_BIT(ve->type);
+    release_caches(list);
 }
 
 static void prepend_val_entry(Value* val, Literal* ve)
@@ -137,6 +159,9 @@ static void prepend_val_entry(Value* val, Literal* ve)
     else
         list->last = ve;
     list->first = ve;
+    list->count++;
+    list->types |= TYPE_BIT(ve->type);
+    release_caches(list);
 }
 
 static void replace_val_entry(Value* val, Literal* ve, int index)
@@ -144,25 +169,36 @@ static void replace_val_entry(Value* val, Literal* ve, int index)
     Literal* tmp = NULL;
     int i;
 
-    resetValIndex(val);
-    for(i = 0, tmp = iterateVal(val);
+    // the index in the list is not used, so that other threads can read it
+    for(i = 0, tmp = val->list->first;
         i < index && tmp != NULL;
-        i++, tmp = iterateVal(val)) { /* do nothing here */ }
+        i++, tmp = tmp->next) { /* do nothing here */ }
 
     if(tmp == NULL)
         append_val_entry(val, ve);
     else {
+        LiteralList* list = val->list;
+
         ve->next = tmp->next;
         ve->prev = tmp->prev;
         if(ve->next != NULL)
             ve->next->prev = ve;
+        else
+            list->last = ve;
         if(ve->prev != NULL)
             ve->prev->next = ve;
+        else
+            list->first = ve;
 
         if(tmp->type == VAL_STR)
             _free(tmp->data.str);
         _free(tmp);
 
+        // the type that was replaced may not be in the list any more
+        list->types = 0;
+        for(tmp = list->first; tmp != NULL; tmp = tmp->next)
+            list->types |= TYPE_BIT(tmp->type);
+        release_caches(list);
     }
 }
 
@@ -288,16 +324,18 @@ static const char* do_str_subs(const char* str)
         return do_str_subs(s->buf);
 }
 
-Value* createVal(const char* name)
+/*
+ * Create a value in the given store. A NULL store is the global config store.
+ * Other stores are used by the parser to build fragments that are merged into
+ * the global store later.
+ */
+static Value* new_value(const char* name)
 {
-    assert(name != NULL);
-
     Value* val = _alloc_ds(Value);
     if(name[0] == '.')
         val->name = _copy_str(&name[1]);
     else
         val->name = _copy_str(name);
-    _free(name);
     val->left = NULL;
     val->right = NULL;
 
@@ -305,15 +343,399 @@ Value* createVal(const char* name)
     val->list->first =
         val->list->last =
         val->list->index = NULL;
+    val->list->count = 0;
+    val->list->types = 0;
+    val->list->num_cache = NULL;
+    val->list->fnum_cache = NULL;
 
-    if(cfg_store != NULL)
-        add_value(cfg_store, val); // there is nothing in the value yet.
+    return val;
+}
+
+static void free_value(Value* val)
+{
+    clearValList(val);
+    _free(val->list);
+    _free(val->name);
+    _free(val);
+}
+
+/*
+ * Move the literals from one value to another according to the policy. The
+ * source value is left empty.
+ */
+static void merge_val_lists(Value* dest, Value* src, int policy)
+{
+    Literal* lit;
+    Literal* next;
+
+    switch(policy) {
+        case CFG_REPLACE:
+            clearValList(dest);
+            // fall through
+        case CFG_APPEND:
+            for(lit = src->list->first; lit != NULL; lit = next) {
+                next = lit->next;
+                lit->prev = lit->next = NULL;
+                append_val_entry(dest, lit);
+            }
+            break;
+        case CFG_PREPEND:
+            for(lit = src->list->last; lit != NULL; lit = next) {
+                next = lit->prev;
+                lit->prev = lit->next = NULL;
+                prepend_val_entry(dest, lit);
+            }
+            break;
+        default: cfgFatalError("unknown duplicate policy: %d", policy);
+    }
+
+    src->list->first =
+        src->list->last =
+        src->list->index = NULL;
+    src->list->count = 0;
+    src->list->types = 0;
+    release_caches(src->list);
+}
+
+/*
+ * Create a value in the given store. A NULL store is the global config store.
+ * Other stores are used by the parser to build fragments that are merged into
+ * the global store later. If the name is already in the store, then that
+ * value is returned and literals are added to the end of it. This is the
+ * same as CFG_APPEND, and it is what the parser and createVal() always do.
+ */
+Value* create_store_val(Value** store, const char* name)
+{
+    assert(name != NULL);
+
+    if(store == NULL)
+        store = &cfg_store;
+
+    Value* val = new_value(name);
+    _free(name);
+
+    if(*store != NULL) {
+        Value* old = add_value(*store, val); // there is nothing in the value yet.
+        if(old != NULL) {
+            cfgWarning("value '%s' already exists, adding to it", old->name);
+            free_value(val);
+            return old;
+        }
+    }
+    else
+        *store = val;
+
+    if(store == &cfg_store)
+        store_gen++;
+
+    return val;
+}
+
+static Value** find_link(Value** tree, const char* name)
+{
+    while(*tree != NULL) {
+        int x = strcmp((*tree)->name, name);
+        if(x > 0)
+            tree = &(*tree)->right;
+        else if(x < 0)
+            tree = &(*tree)->left;
+        else
+            break;
+    }
+
+    return tree;
+}
+
+/*
+ * Move the values in a fragment store into the global store one at a time.
+ * A value that is already in the store may be in use by another thread, so
+ * it is not changed. A new value with both
+ * lists takes its place in the tree, and the old one is put on the retired
+ * list, linked by its right pointer, to be released when it is not in use.
+ */
+void publish_store_vals(Value* frag, Value** retired)
+{
+    if(frag == NULL)
+        return;
+
+    Value* left = frag->left;
+    Value* right = frag->right;
+
+    frag->left = NULL;
+    frag->right = NULL;
+
+    Value** link = find_link(&cfg_store, frag->name);
+    Value* old = *link;
+    if(old != NULL) {
+        cfgWarning("value '%s' already exists, adding to it", old->name);
+        Value* val = new_value(old->name);
+        for(Literal* lit = old->list->first; lit != NULL; lit = lit->next)
+            append_val_entry(val, copy_literal(lit));
+        merge_val_lists(val, frag, CFG_APPEND);
+        free_value(frag);
+
+        val->left = old->left;
+        val->right = old->right;
+        *link = val;
+
+        old->left = NULL;
+        old->right = *retired;
+        *retired = old;
+    }
     else
-        cfg_store = val;
+        *link = frag;
+    store_gen++;
+
+    publish_store_vals(right, retired);
+    publish_store_vals(left, retired);
+}
+
+/*
+ * Release the values that publish_store_vals() replaced.
+ */
+void free_retired_vals(Value* retired)
+{
+    Value* next;
+
+    for(; retired != NULL; retired = next) {
+        next = retired->right;
+        free_value(retired);
+    }
+}
+
+Value* create_detached_val(const char* name)
+{
+    assert(name != NULL);
+    return new_value(name);
+}
+
+void init_val_array(ValArray* arr)
+{
+    arr->cap = 1 << 4;
+    arr->len = 0;
+    arr->list = _alloc_ds_array(Value*, arr->cap);
+}
+
+static void add_val_array(ValArray* arr, Value* val)
+{
+    if(arr->len+1 > arr->cap) {
+        arr->cap <<= 1;
+        arr->list = _realloc_ds_array(arr->list, Value*, arr->cap);
+    }
+    arr->list[arr->len++] = val;
+}
+
+/*
+ * Smaller names are to the right, so this gives them in order. A store that
+ * was built one value at a time can be very deep, so this does not recurse.
+ */
+static void flatten_store(ValArray* arr, Value* tree)
+{
+    ValArray stack;
+
+    init_val_array(&stack);
+
+    while(tree != NULL || stack.len > 0) {
+        for(; tree != NULL; tree = tree->right)
+            add_val_array(&stack, tree);
+
+        tree = stack.list[--stack.len];
+        add_val_array(arr, tree);
+        tree = tree->left;
+    }
+
+    _free(stack.list);
+}
+
+static Value* build_store(Value** list, int count)
+{
+    if(count <= 0)
+        return NULL;
+
+    int mid = count / 2;
+    Value* val = list[mid];
+    val->right = build_store(list, mid);
+    val->left = build_store(&list[mid+1], count-mid-1);
 
     return val;
 }
 
+static int load_vals(Value** vals, int count, int policy, int warn)
+{
+    ValArray store;
+    ValArray out;
+    int dups = 0;
+
+    init_val_array(&store);
+    flatten_store(&store, cfg_store);
+
+    out.cap = 1 << 4;
+    while(out.cap < store.len+count)
+        out.cap <<= 1;
+    out.len = 0;
+    out.list = _alloc_ds_array(Value*, out.cap);
+
+    int i = 0, j = 0;
+    while(i < store.len || j < count) {
+        Value* val;
+        if(j >= count || (i < store.len && strcmp(store.list[i]->name, vals[j]->name) <= 0))
+            val = store.list[i++];
+        else
+            val = vals[j++];
+
+        Value* last = (out.len > 0)? out.list[out.len-1]: NULL;
+        if(last != NULL && !strcmp(last->name, val->name)) {
+            if(warn)
+                cfgWarning("value '%s' already exists, adding to it", last->name);
+            merge_val_lists(last, val, policy);
+            free_value(val);
+            dups++;
+        }
+        else
+            add_val_array(&out, val);
+    }
+
+    cfg_store = build_store(out.list, out.len);
+    store_gen++;
+
+    _free(store.list);
+    _free(out.list);
+
+    return dups;
+}
+
+/*
+ * Load values that are not in any store into the global store. They must be
+ * sorted by name, and values with the same name must be in the order they
+ * were given. Values with a name that is already in the store are merged
+ * into it according to the policy. The store is rebuilt so that it is
+ * balanced. Returns the number of duplicates that were merged.
+ */
+int load_store_vals(Value** vals, int count, int policy)
+{
+    return load_vals(vals, count, policy, 0);
+}
+
+/*
+ * Move the values in a fragment store to the end of the array, in order, and
+ * leave the store empty.
+ */
+void take_store_vals(ValArray* arr, Value** store)
+{
+    flatten_store(arr, *store);
+    *store = NULL;
+}
+
+/*
+ * A merge sort by name that keeps values with the same name in the order
+ * they were added.
+ */
+void sort_val_array(ValArray* arr)
+{
+    int len = arr->len;
+    Value** src = arr->list;
+    Value** dst = _alloc_ds_array(Value*, len+1);
+    Value** tmp;
+
+    for(int width = 1; width < len; width <<= 1) {
+        for(int low = 0; low < len; low += width * 2) {
+            int mid = (low+width < len)? low+width: len;
+            int high = (low+width*2 < len)? low+width*2: len;
+            int i = low, j = mid, k = low;
+
+            while(i < mid && j < high)
+                dst[k++] = (strcmp(src[j]->name, src[i]->name) < 0)? src[j++]: src[i++];
+            while(i < mid)
+                dst[k++] = src[i++];
+            while(j < high)
+                dst[k++] = src[j++];
+        }
+
+        tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    if(src != arr->list) {
+        memcpy(arr->list, src, sizeof(Value*) * len);
+        dst = src;
+    }
+    _free(dst);
+}
+
+/*
+ * Move the values in the sorted arrays into the global store. The arrays are
+ * given in file order, and a name that is given more than once is appended
+ * in that order, with a warning, the same as the parser does. The arrays are
+ * merged all at once and the store is rebuilt so that it is balanced.
+ */
+void merge_store_vals(ValArray* arrs, int count)
+{
+    int* heads = _alloc_ds_array(int, count);
+    ValArray out;
+    int total = 0;
+
+    for(int i = 0; i < count; i++) {
+        heads[i] = 0;
+        total += arrs[i].len;
+    }
+
+    out.cap = 1 << 4;
+    while(out.cap < total)
+        out.cap <<= 1;
+    out.len = 0;
+    out.list = _alloc_ds_array(Value*, out.cap);
+
+    // there is one array for each thread, so looking at all of them for every
+    // value is cheap. The first one wins a tie, to keep the file order.
+    for(;;) {
+        int pick = -1;
+        for(int i = 0; i < count; i++) {
+            if(heads[i] < arrs[i].len && (pick < 0 ||
+                    strcmp(arrs[i].list[heads[i]]->name, arrs[pick].list[heads[pick]]->name) < 0))
+                pick = i;
+        }
+
+        if(pick < 0)
+            break;
+
+        Value* val = arrs[pick].list[heads[pick]++];
+        val->left = NULL;
+        val->right = NULL;
+        add_val_array(&out, val);
+    }
+
+    load_vals(out.list, out.len, CFG_APPEND, 1);
+
+    _free(heads);
+    _free(out.list);
+}
+
+Value* get_cfg_store()
+{
+    return cfg_store;
+}
+
+unsigned long get_store_gen()
+{
+    return store_gen;
+}
+
+Value* find_store_val(Value* store, const char* name)
+{
+    assert(name != NULL);
+
+    if(store != NULL)
+        return find_value(store, name);
+    else
+        return NULL;
+}
+
+Value* createVal(const char* name)
+{
+    return create_store_val(NULL, name);
+}
+
 Literal* createLiteral(ValType type, const char* str)
 {
     Literal* lit = _alloc_ds(Literal);
@@ -352,6 +774,13 @@ void clearValList(Value* val)
         _free(elem);
         elem = NULL;
     }
+
+    val->list->first =
+        val->list->last =
+        val->list->index = NULL;
+    val->list->count = 0;
+    val->list->types = 0;
+    release_caches(val->list);
 }
 
 void appendLiteral(Value* val, Literal* lit)
@@ -380,10 +809,10 @@ Literal* getLiteral(Value* val, int index)
     Literal* tmp = NULL;
     int i;
 
-    resetValIndex(val);
-    for(i = 0, tmp = iterateVal(val);
+    // the index in the list is not used, so that other threads can read it
+    for(i = 0, tmp = val->list->first;
         i < index && tmp != NULL;
-        i++, tmp = iterateVal(val)) { /* do nothing here */ }
+        i++, tmp = tmp->next) { /* do nothing here */ }
 
     return tmp; // NULL if the index is invalid
 }
@@ -439,14 +868,174 @@ unsigned char getLiteralAsBool(Value* val, int index)
     }
 }
 
+int getValueCount(Value* val)
+{
+    assert(val != NULL);
+    return val->list->count;
+}
+
+/*
+ * Copy the list into the caller's buffer as NUMs, in one pass. Elements that
+ * are not a NUM are converted the same as getLiteralAsNum() does, but only
+ * one warning is given for the whole list. At most max elements are stored
+ * and the number of elements in the list is returned, so calling this with
+ * a max of zero gets the size of the buffer that is needed.
+ */
+int getValueAsNumArray(Value* val, long int* buf, int max)
+{
+    assert(val != NULL);
+    assert(buf != NULL || max == 0);
+
+    LiteralList* list = val->list;
+    Literal* lit = list->first;
+    int len = (max < list->count)? max: list->count;
+    int i;
+
+    if(len <= 0)
+        return list->count;
+
+    if(list->num_cache != NULL)
+        memcpy(buf, list->num_cache, sizeof(long int) * len);
+    else if(list->types == TYPE_BIT(VAL_NUM)) {
+        for(i = 0; i < len; i++, lit = lit->next)
+            buf[i] = lit->data.num;
+    }
+    else {
+        cfgWarning("attempt to get a list that is not all NUM as NUM");
+        for(i = 0; i < len; i++, lit = lit->next)
+            buf[i] = (lit->type == VAL_NUM)? lit->data.num: strtol(lit->str, NULL, 10);
+    }
+
+    return list->count;
+}
+
+/*
+ * Widening is done from a contiguous array so the compiler can vectorize it.
+ */
+static void widen_nums(double* restrict out, const long int* restrict in, int count)
+{
+    for(int i = 0; i < count; i++)
+        out[i] = (double)in[i];
+}
+
+/*
+ * Copy the list into the caller's buffer as FNUMs, in one pass. NUMs are
+ * widened without a warning. Anything else is converted the same as
+ * getLiteralAsFnum() does, with one warning for the whole list. Returns the
+ * number of elements in the list, the same as getValueAsNumArray().
+ */
+int getValueAsFnumArray(Value* val, double* buf, int max)
+{
+    assert(val != NULL);
+    assert(buf != NULL || max == 0);
+
+    LiteralList* list = val->list;
+    Literal* lit = list->first;
+    int len = (max < list->count)? max: list->count;
+    int i;
+
+    if(len <= 0)
+        return list->count;
+
+    if(list->fnum_cache != NULL)
+        memcpy(buf, list->fnum_cache, sizeof(double) * len);
+    else if(list->types == TYPE_BIT(VAL_FNUM)) {
+        for(i = 0; i < len; i++, lit = lit->next)
+            buf[i] = lit->data.fnum;
+    }
+    else if(list->types == TYPE_BIT(VAL_NUM)) {
+        int count;
+        widen_nums(buf, getCachedNumArray(val, &count), len);
+    }
+    else {
+        if(list->types & ~(TYPE_BIT(VAL_NUM) | TYPE_BIT(VAL_FNUM)))
+            cfgWarning("attempt to get a list that is not all FNUM as FNUM");
+        for(i = 0; i < len; i++, lit = lit->next) {
+            switch(lit->type) {
+                case VAL_FNUM: buf[i] = lit->data.fnum; break;
+                case VAL_NUM: buf[i] = (double)lit->data.num; break;
+                default: buf[i] = strtod(lit->str, NULL); break;
+            }
+        }
+    }
+
+    return list->count;
+}
+
+/*
+ * Return the list as a contiguous array of NUMs that belongs to the value.
+ * The array is kept until the list is changed, so reading it again is free.
+ */
+const long int* getCachedNumArray(Value* val, int* count)
+{
+    assert(val != NULL);
+    assert(count != NULL);
+
+    LiteralList* list = val->list;
+    if(list->num_cache == NULL && list->count > 0) {
+        long int* cache = _alloc_ds_array(long int, list->count);
+        getValueAsNumArray(val, cache, list->count);
+        list->num_cache = cache;
+    }
+
+    *count = list->count;
+    return list->num_cache;
+}
+
+/*
+ * Return the list as a contiguous array of FNUMs that belongs to the value.
+ * Like getCachedNumArray(), it is kept until the list is changed.
+ */
+const double* getCachedFnumArray(Value* val, int* count)
+{
+    assert(val != NULL);
+    assert(count != NULL);
+
+    LiteralList* list = val->list;
+    if(list->fnum_cache == NULL && list->count > 0) {
+        double* cache = _alloc_ds_array(double, list->count);
+        getValueAsFnumArray(val, cache, list->count);
+        list->fnum_cache = cache;
+    }
+
+    *count = list->count;
+    return list->fnum_cache;
+}
+
 Value* findValue(const char* name)
 {
     assert(name != NULL);
 
+    Value* val = NULL;
     if(cfg_store != NULL)
-        return find_value(cfg_store, name);
-    else
-        return NULL;
+        val = find_value(cfg_store, name);
+
+    // then try the shared image, if one is attached
+    if(val == NULL)
+        val = find_image_val(name);
+
+    return val;
+}
+
+static void free_values(Value* tree)
+{
+    if(tree == NULL)
+        return;
+
+    free_values(tree->right);
+    free_values(tree->left);
+    free_value(tree);
+}
+
+/*
+ * Remove everything from the config store, so that a different config, or
+ * the same compiled config with other defines, can be loaded.
+ */
+void clearConfig()
+{
+    free_values(cfg_store);
+    cfg_store = NULL;
+    store_gen++;
 }
 
 void resetValIndex(Value* val)
@@ -10,6 +10,13 @@ typedef enum {
     VAL_BOOL,
 } ValType;
 
+/*
+ * What happens to the literals of a value that is given more than once.
+ */
+#define CFG_REPLACE     0   // the new ones replace the old ones
+#define CFG_APPEND      1   // the new ones go after the old ones
+#define CFG_PREPEND     2   // the new ones go before the old ones
+
 typedef struct _literal {
     ValType type;
     const char* str;
@@ -23,10 +30,19 @@ typedef struct _literal {
     struct _literal* next;
 } Literal;
 
+/*
+ * The type mask has a bit set, (1 << type), for every type that is in the
+ * list. The caches are contiguous copies of the list that are made by the
+ * array functions and they are released when the list is changed.
+ */
 typedef struct {
     Literal* first;
     Literal* last;
     Literal* index;
+    int count;
+    unsigned int types;
+    long int* num_cache;
+    double* fnum_cache;
 } LiteralList;
 
 typedef struct _value {
@@ -52,6 +68,12 @@ long int getLiteralAsNum(Value* val, int index);
 double getLiteralAsFnum(Value* val, int index);
 unsigned char getLiteralAsBool(Value* val, int index);
 
+int getValueCount(Value* val);
+int getValueAsNumArray(Value* val, long int* buf, int max);
+int getValueAsFnumArray(Value* val, double* buf, int max);
+const long int* getCachedNumArray(Value* val, int* count);
+const double* getCachedFnumArray(Value* val, int* count);
+
 Value* findValue(const char* name);
 const char* formatStrLiteral(const char* str);
 